@@ -0,0 +1,84 @@
+#ifndef AudioBuffer_hpp
+#define AudioBuffer_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// buffers kept for reuse, more than the audio channel and the sink hold at once
+#define AUDIO_BUFFER_POOL_SIZE 48
+
+/* storage of the audio frames. a released buffer keeps its capacity in the
+ * pool, after the first frames capture and delivery don't allocate.
+ */
+class AudioBufferPool
+{
+public:
+    static std::vector<uint8_t> acquire(size_t size)
+    {
+        std::vector<uint8_t> buf;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!buffers.empty())
+            {
+                buf = std::move(buffers.back());
+                buffers.pop_back();
+            }
+        }
+        buf.resize(size);
+        return buf;
+    }
+
+    static void release(std::vector<uint8_t> &&buf)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (buffers.capacity() == 0)
+            buffers.reserve(AUDIO_BUFFER_POOL_SIZE);
+        if (buffers.size() < AUDIO_BUFFER_POOL_SIZE)
+            buffers.push_back(std::move(buf));
+    }
+
+private:
+    static inline std::vector<std::vector<uint8_t>> buffers;
+    static inline std::mutex mutex;
+};
+
+// payload of an AudioFrame, returned to the pool when it's destroyed
+class AudioBuffer
+{
+public:
+    AudioBuffer() = default;
+    explicit AudioBuffer(size_t size) : buf(AudioBufferPool::acquire(size)) {}
+    AudioBuffer(AudioBuffer &&other) noexcept : buf(std::move(other.buf)) {}
+    AudioBuffer &operator=(AudioBuffer &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            buf = std::move(other.buf);
+        }
+        return *this;
+    }
+    AudioBuffer(const AudioBuffer &) = delete;
+    AudioBuffer &operator=(const AudioBuffer &) = delete;
+    ~AudioBuffer() { release(); }
+
+    uint8_t *data() { return buf.data(); }
+    const uint8_t *data() const { return buf.data(); }
+    size_t size() const { return buf.size(); }
+    bool empty() const { return buf.empty(); }
+    uint8_t &operator[](size_t i) { return buf[i]; }
+
+private:
+    void release()
+    {
+        if (buf.capacity())
+            AudioBufferPool::release(std::move(buf));
+        buf = std::vector<uint8_t>();
+    }
+
+    std::vector<uint8_t> buf;
+};
+
+#endif
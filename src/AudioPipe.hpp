@@ -0,0 +1,120 @@
+#ifndef AudioPipe_hpp
+#define AudioPipe_hpp
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <semaphore>
+#include <vector>
+#include <imp/imp_audio.h>
+
+// PCM frames the capture stage can queue ahead of the encoder
+#define AUDIO_PIPE_FRAMES 8
+// stage timings are published once per interval, in ms
+#define AUDIO_STATS_INTERVAL 1000
+
+// a PCM frame, virAddr points to data
+struct AudioPipeFrame
+{
+    IMPAudioFrame frame{};
+    std::vector<uint8_t> data;
+};
+
+/* single producer, single consumer ring of PCM frames between the capture
+ * and the encoder thread. the slots are sized once and filled in place,
+ * neither side takes a lock. a full ring drops the new frame, the capture
+ * never waits for the encoder.
+ */
+class AudioPipe
+{
+public:
+    explicit AudioPipe(size_t frameSize)
+    {
+        for (AudioPipeFrame &slot : slots)
+            slot.data.resize(frameSize);
+    }
+
+    // capture side, the slot to fill or nullptr if the ring is full
+    AudioPipeFrame *writeSlot()
+    {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == AUDIO_PIPE_FRAMES)
+            return nullptr;
+        return &slots[t % AUDIO_PIPE_FRAMES];
+    }
+
+    void commit()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        ready.release();
+    }
+
+    // encoder side, the oldest frame or nullptr after timeout_ms
+    AudioPipeFrame *readSlot(int timeout_ms)
+    {
+        if (!ready.try_acquire_for(std::chrono::milliseconds(timeout_ms)))
+            return nullptr;
+        return &slots[head.load(std::memory_order_relaxed) % AUDIO_PIPE_FRAMES];
+    }
+
+    // the slot of readSlot is free again
+    void release()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    unsigned int depth() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<AudioPipeFrame, AUDIO_PIPE_FRAMES> slots;
+    std::atomic<unsigned int> head{0};
+    std::atomic<unsigned int> tail{0};
+    std::counting_semaphore<AUDIO_PIPE_FRAMES> ready{0};
+};
+
+/* timing of a pipeline stage. the stage records every frame, readers get
+ * the values of the last interval.
+ */
+struct AudioStageStats
+{
+    // frames waiting in the queue behind the stage
+    std::atomic<unsigned int> queue{0};
+    std::atomic<unsigned int> frame_us{0};
+    std::atomic<unsigned int> max_us{0};
+    // frames lost because the queue behind the stage was full
+    std::atomic<unsigned int> dropped{0};
+
+    // stage thread only
+    void record(std::chrono::steady_clock::time_point start, unsigned int depth)
+    {
+        auto now = std::chrono::steady_clock::now();
+        unsigned int us = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        sum += us;
+        count++;
+        if (us > peak)
+            peak = us;
+        queue = depth;
+
+        if (now - since >= std::chrono::milliseconds(AUDIO_STATS_INTERVAL))
+        {
+            frame_us = sum / count;
+            max_us = peak;
+            sum = 0;
+            count = 0;
+            peak = 0;
+            since = now;
+        }
+    }
+
+private:
+    uint64_t sum{0};
+    unsigned int count{0};
+    unsigned int peak{0};
+    std::chrono::steady_clock::time_point since{};
+};
+
+#endif
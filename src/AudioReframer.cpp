@@ -1,37 +1,76 @@
 #include "AudioReframer.hpp"
 #include <algorithm>
+#include <cstdlib>
 #include <stdexcept>
 
-AudioReframer::AudioReframer(unsigned int inputSampleRate, unsigned int inputSamplesPerFrame, unsigned int outputSamplesPerFrame)
-    : inputSampleRate(inputSampleRate),
+AudioReframer::AudioReframer(unsigned int sampleRate, unsigned int channels, unsigned int inputSamplesPerFrame,
+                             unsigned int outputSamplesPerFrame)
+    : sampleRate(sampleRate),
+      channels(channels),
       inputSamplesPerFrame(inputSamplesPerFrame),
       outputSamplesPerFrame(outputSamplesPerFrame),
-      currentTimestamp(0),
-      samplesAccumulated(0),
-      buffer(2 * std::max(inputSamplesPerFrame, outputSamplesPerFrame) * sizeof(uint16_t))
+      bytesPerSample(channels * sizeof(int16_t)),
+      anchored(false),
+      anchorTimestamp(0),
+      samplesSinceAnchor(0),
+      buffer(AUDIO_REFRAMER_DEPTH * std::max(inputSamplesPerFrame, outputSamplesPerFrame) * channels * sizeof(int16_t))
 {
+    if (sampleRate == 0 || channels == 0)
+    {
+        throw std::invalid_argument("Sample rate and channel count must be greater than zero.");
+    }
+
     if (inputSamplesPerFrame == 0 || outputSamplesPerFrame == 0)
     {
         throw std::invalid_argument("Number of samples per frame must be greater than zero.");
     }
 }
 
-void AudioReframer::addFrame(const uint8_t* frameData, int64_t timestamp)
+int64_t AudioReframer::samplesToUs(int64_t samples) const
+{
+    return samples * 1000000 / sampleRate;
+}
+
+size_t AudioReframer::addFrame(const uint8_t* frameData, size_t len, int64_t timestamp)
 {
     if (frameData == nullptr)
     {
         throw std::invalid_argument("Frame data cannot be null.");
     }
 
-    size_t inputFrameSize = inputSamplesPerFrame * sizeof(uint16_t);
-    buffer.push(frameData, inputFrameSize);
+    // whole samples only, a frame larger than the buffer keeps its newest part
+    len -= len % bytesPerSample;
+    if (len > buffer.getCapacity())
+    {
+        frameData += len - buffer.getCapacity();
+        timestamp += samplesToUs((len - buffer.getCapacity()) / bytesPerSample);
+        len = buffer.getCapacity();
+    }
+
+    size_t dropped = 0;
+    if (len > buffer.getFree())
+    {
+        size_t bytes = len - buffer.getFree();
+        bytes += (bytesPerSample - bytes % bytesPerSample) % bytesPerSample;
+        buffer.discard(bytes);
+        dropped = bytes / bytesPerSample;
+        samplesSinceAnchor += dropped;
+    }
 
-    if (samplesAccumulated == 0)
+    // timestamp of the first buffered sample, re-anchor if the input is off
+    // by more than half a frame, small jitter of the source is ignored
+    int64_t buffered = buffer.getSize() / bytesPerSample;
+    int64_t head = timestamp - samplesToUs(buffered);
+    int64_t expected = anchorTimestamp + samplesToUs(samplesSinceAnchor);
+    if (!anchored || std::abs(head - expected) > samplesToUs(inputSamplesPerFrame) / 2)
     {
-        currentTimestamp = timestamp; // Initialize timestamp with the first frame
+        anchorTimestamp = head;
+        samplesSinceAnchor = 0;
+        anchored = true;
     }
 
-    samplesAccumulated += inputSamplesPerFrame;
+    buffer.push(frameData, len);
+    return dropped;
 }
 
 void AudioReframer::getReframedFrame(uint8_t* frameData, int64_t& timestamp)
@@ -45,16 +84,13 @@ void AudioReframer::getReframedFrame(uint8_t* frameData, int64_t& timestamp)
         throw std::invalid_argument("Output frame cannot be null.");
     }
 
-    size_t outputFrameSize = outputSamplesPerFrame * sizeof(uint16_t);
-    buffer.fetch(frameData, outputFrameSize);
-    samplesAccumulated -= outputSamplesPerFrame;
+    buffer.fetch(frameData, outputFrameSize());
 
-    timestamp = currentTimestamp;
-    currentTimestamp += (outputSamplesPerFrame * 1000) / inputSampleRate;
+    timestamp = anchorTimestamp + samplesToUs(samplesSinceAnchor);
+    samplesSinceAnchor += outputSamplesPerFrame;
 }
 
 bool AudioReframer::hasMoreFrames() const
 {
-    return samplesAccumulated >= outputSamplesPerFrame;
+    return buffer.getSize() >= outputFrameSize();
 }
-
@@ -5,26 +5,45 @@
 #include <cstddef>
 #include "RingBuffer.hpp"
 
+// input frames the buffer holds before the oldest samples are dropped
+#define AUDIO_REFRAMER_DEPTH 4
+
+/* cuts 16 bit interleaved audio of any channel count into frames of a fixed
+ * sample count. timestamps are in microseconds like the IMP frames and are
+ * derived from a sample count since the last anchor, so they don't drift.
+ * the anchor moves if the input timestamps jump or samples were dropped.
+ */
 class AudioReframer
 {
 public:
-    AudioReframer(unsigned int inputSampleRate, unsigned int inputSamplesPerFrame, unsigned int outputSamplesPerFrame);
+    AudioReframer(unsigned int sampleRate, unsigned int channels, unsigned int inputSamplesPerFrame,
+                  unsigned int outputSamplesPerFrame);
 
-    void addFrame(const uint8_t* frameData, int64_t timestamp);
+    // len in bytes, returns the samples per channel dropped to make room
+    size_t addFrame(const uint8_t* frameData, size_t len, int64_t timestamp);
 
     void getReframedFrame(uint8_t* frameData, int64_t& timestamp);
 
     bool hasMoreFrames() const;
 
+    size_t outputFrameSize() const { return outputSamplesPerFrame * bytesPerSample; }
+
 private:
-    unsigned int inputSampleRate;
+    int64_t samplesToUs(int64_t samples) const;
+
+    unsigned int sampleRate;
+    unsigned int channels;
     unsigned int inputSamplesPerFrame;
     unsigned int outputSamplesPerFrame;
-    int64_t currentTimestamp;
-    size_t samplesAccumulated;
+    // bytes of one sample of all channels
+    size_t bytesPerSample;
+
+    bool anchored;
+    int64_t anchorTimestamp;
+    // samples per channel fetched or dropped since the anchor
+    int64_t samplesSinceAnchor;
 
     RingBuffer buffer;
 };
 
 #endif // AUDIO_REFRAMER_HPP
-
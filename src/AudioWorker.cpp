@@ -5,10 +5,40 @@
 #include "WorkerUtils.hpp"
 #include "globals.hpp"
 
+#include <chrono>
+#include <cmath>
+
 #define MODULE "AudioWorker"
 
+// the encoder stage checks for shutdown between waits, in ms
+#define AUDIO_PIPE_WAIT_MS 100
+
 #if defined(AUDIO_SUPPORT)
 
+// peak level of 16 bit samples in dBFS, -96 for digital silence
+static int peak_level(const int16_t *samples, size_t count)
+{
+    int peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int v = std::abs((int) samples[i]);
+        if (v > peak)
+            peak = v;
+    }
+    if (peak == 0)
+        return -96;
+    return (int) std::lround(20.0 * std::log10(peak / 32768.0));
+}
+
+/* every 16 bit sample becomes a left and right pair in one 32 bit word,
+ * the loop has no branches so the compiler vectorizes it
+ */
+static void mono_to_stereo16(const uint16_t *mono, uint32_t *stereo, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        stereo[i] = (uint32_t) mono[i] * 0x00010001u;
+}
+
 AudioWorker::AudioWorker(int chn)
     : encChn(chn)
 {
@@ -42,7 +72,7 @@ void AudioWorker::process_audio_frame(IMPAudioFrame &frame)
                                             << global_audio[encChn]->aeChn << ") failed");
         }
         else if (IMP_AENC_PollingStream(global_audio[encChn]->aeChn,
-                                        cfg->general.imp_polling_timeout)
+                                        cfg->snapshot()->general.imp_polling_timeout)
                  != 0)
         {
             LOG_ERROR("IMP_AENC_PollingStream(" << global_audio[encChn]->devId << ", "
@@ -62,19 +92,21 @@ void AudioWorker::process_audio_frame(IMPAudioFrame &frame)
 
     if (end > start)
     {
-        af.data.insert(af.data.end(), start, end);
+        af.data = AudioBuffer(end - start);
+        memcpy(af.data.data(), start, end - start);
     }
 
     if (!af.data.empty() && global_audio[encChn]->hasDataCallback
         && (global_video[0]->hasDataCallback || global_video[1]->hasDataCallback))
     {
-        if (!global_audio[encChn]->msgChannel->write(af))
+        if (!global_audio[encChn]->msgChannel->write(std::move(af)))
         {
 #if defined(USE_AUDIO_STREAM_REPLICATOR)
-            LOG_DDEBUG("audio encChn:" << encChn << ", size:" << af.data.size() << " clogged!");
+            LOG_DDEBUG("audio encChn:" << encChn << " clogged!");
 #else
-            LOG_ERROR("audio encChn:" << encChn << ", size:" << af.data.size() << " clogged!");
+            LOG_ERROR("audio encChn:" << encChn << " clogged!");
 #endif
+            global_audio[encChn]->encoder_stats.dropped++;
         }
         else
         {
@@ -94,62 +126,134 @@ void AudioWorker::process_audio_frame(IMPAudioFrame &frame)
 
 void AudioWorker::process_frame(IMPAudioFrame &frame)
 {
-    if (global_audio[encChn]->imp_audio->outChnCnt == 2 && frame.soundmode == AUDIO_SOUND_MODE_MONO)
+    if (frame.bitwidth == 16)
+    {
+        global_audio[encChn]->level = peak_level((const int16_t *) frame.virAddr,
+                                                 frame.len / sizeof(int16_t));
+    }
+
+    AudioPipeFrame *slot = pipe->writeSlot();
+    if (!slot)
+    {
+        global_audio[encChn]->capture_stats.dropped++;
+        LOG_DDEBUG("audio encChn:" << encChn << " encoder behind, frame dropped");
+        return;
+    }
+
+    bool stereo = global_audio[encChn]->imp_audio->outChnCnt == 2 && frame.soundmode == AUDIO_SOUND_MODE_MONO;
+    size_t size = stereo ? frame.len * 2 : frame.len;
+    // the slots are sized for the expected frame, only grows on a surprise
+    if (slot->data.size() < size)
+        slot->data.resize(size);
+
+    if (stereo)
     {
         size_t sample_size = frame.bitwidth / 8;
         size_t num_samples = frame.len / sample_size;
-        size_t stereo_size = frame.len * 2;
-        uint8_t *stereo_buffer = new uint8_t[stereo_size];
 
-        for (size_t i = 0; i < num_samples; i++)
+        if (sample_size == sizeof(int16_t))
+        {
+            mono_to_stereo16((const uint16_t *) frame.virAddr, (uint32_t *) slot->data.data(), num_samples);
+        }
+        else
         {
-            uint8_t *mono_sample = ((uint8_t *) frame.virAddr) + (i * sample_size);
-            uint8_t *stereo_left = stereo_buffer + (i * sample_size * 2);
-            uint8_t *stereo_right = stereo_left + sample_size;
-            memcpy(stereo_left, mono_sample, sample_size);
-            memcpy(stereo_right, mono_sample, sample_size);
+            for (size_t i = 0; i < num_samples; i++)
+            {
+                uint8_t *mono_sample = ((uint8_t *) frame.virAddr) + (i * sample_size);
+                uint8_t *stereo_left = slot->data.data() + (i * sample_size * 2);
+                memcpy(stereo_left, mono_sample, sample_size);
+                memcpy(stereo_left + sample_size, mono_sample, sample_size);
+            }
         }
+    }
+    else
+    {
+        memcpy(slot->data.data(), frame.virAddr, frame.len);
+    }
+
+    slot->frame = frame;
+    slot->frame.virAddr = (uint32_t *) slot->data.data();
+    slot->frame.len = size;
+    if (stereo)
+        slot->frame.soundmode = AUDIO_SOUND_MODE_STEREO;
 
-        IMPAudioFrame stereo_frame = frame;
-        stereo_frame.virAddr = (uint32_t *) stereo_buffer;
-        stereo_frame.len = stereo_size;
-        stereo_frame.soundmode = AUDIO_SOUND_MODE_STEREO;
+    pipe->commit();
 
-        process_audio_frame(stereo_frame);
-        delete[] stereo_buffer;
+    // without an encoder thread the capture encodes itself
+    if (!encoding && (slot = pipe->readSlot(0)))
+    {
+        process_audio_frame(slot->frame);
+        pipe->release();
     }
-    else
+}
+
+void AudioWorker::encode_run()
+{
+    LOG_DEBUG("Start audio encoder loop for channel " << encChn);
+
+    while (encoding)
     {
-        process_audio_frame(frame);
+        AudioPipeFrame *slot = pipe->readSlot(AUDIO_PIPE_WAIT_MS);
+        if (!slot)
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        process_audio_frame(slot->frame);
+        pipe->release();
+
+        global_audio[encChn]->encoder_stats.record(start, global_audio[encChn]->msgChannel->size());
     }
 }
 
+void *AudioWorker::encoder_entry(void *arg)
+{
+    static_cast<AudioWorker *>(arg)->encode_run();
+    return nullptr;
+}
+
 void AudioWorker::run()
 {
     LOG_DEBUG("Start audio processing run loop for channel " << encChn);
 
-    // Initialize AudioReframer only if needed, store in member variable
-    if (global_audio[encChn]->imp_audio->format == IMPAudioFormat::AAC)
+    // Initialize AudioReframer only if needed, store in member variable.
+    // it runs on the mono AI frames, stereo is made from the reframed ones
+    IMPAudio *imp_audio = global_audio[encChn]->imp_audio;
+    if (imp_audio->enc_frame_samples != imp_audio->ai_frame_samples)
     {
         reframer = std::make_unique<AudioReframer>(
-            global_audio[encChn]->imp_audio->sample_rate,
-            /* inputSamplesPerFrame */ global_audio[encChn]->imp_audio->sample_rate * 0.040,
-            /* outputSamplesPerFrame */ 1024);
-        LOG_DEBUG("AudioReframer created for channel " << encChn);
+            imp_audio->sample_rate,
+            /* channels */ 1,
+            /* inputSamplesPerFrame */ imp_audio->ai_frame_samples,
+            /* outputSamplesPerFrame */ imp_audio->enc_frame_samples);
+        LOG_DEBUG("AudioReframer created for channel " << encChn << ", "
+                  << imp_audio->ai_frame_samples << " to " << imp_audio->enc_frame_samples << " samples");
     }
     else
     {
         LOG_DEBUG("AudioReframer not needed or imp_audio not ready for channel " << encChn);
     }
 
+    /* the capture only grabs, reframes and queues PCM, the encoder stage
+     * runs on its own thread so a slow encode doesn't delay IMP_AI_GetFrame
+     */
+    pipe = std::make_unique<AudioPipe>(imp_audio->enc_frame_samples * imp_audio->outChnCnt * sizeof(int16_t));
+    encoding = true;
+    int ret = pthread_create(&encoderThread, nullptr, encoder_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create audio encoder thread for channel " << encChn);
+    if (ret != 0)
+        encoding = false;
+
     while (global_audio[encChn]->running)
     {
-        if (global_audio[encChn]->hasDataCallback && cfg->audio.input_enabled
+        // config values stay the same for this iteration
+        CFGSnapshotRef snap = cfg->snapshot();
+
+        if (global_audio[encChn]->hasDataCallback && snap->audio.input_enabled
             && (global_video[0]->hasDataCallback || global_video[1]->hasDataCallback))
         {
             if (IMP_AI_PollingFrame(global_audio[encChn]->devId,
                                     global_audio[encChn]->aiChn,
-                                    cfg->general.imp_polling_timeout)
+                                    snap->general.imp_polling_timeout)
                 == 0)
             {
                 IMPAudioFrame frame;
@@ -163,20 +267,26 @@ void AudioWorker::run()
                                                  << global_audio[encChn]->aiChn << ") failed");
                 }
 
+                auto start = std::chrono::steady_clock::now();
+
                 if (reframer)
                 {
-                    reframer->addFrame(reinterpret_cast<uint8_t *>(frame.virAddr), frame.timeStamp);
+                    size_t dropped = reframer->addFrame(reinterpret_cast<uint8_t *>(frame.virAddr),
+                                                        frame.len, frame.timeStamp);
+                    if (dropped)
+                        LOG_WARN("AudioReframer overflow, " << dropped << " samples dropped");
+
                     while (reframer->hasMoreFrames())
                     {
-                        size_t frameLen = 1024 * sizeof(uint16_t)
-                                          * global_audio[encChn]->imp_audio->outChnCnt;
-                        std::vector<uint8_t> frameData(frameLen, 0);
+                        size_t frameLen = reframer->outputFrameSize();
+                        if (reframeBuffer.size() < frameLen)
+                            reframeBuffer.resize(frameLen);
                         int64_t audio_ts;
-                        reframer->getReframedFrame(frameData.data(), audio_ts);
+                        reframer->getReframedFrame(reframeBuffer.data(), audio_ts);
                         IMPAudioFrame reframed = {.bitwidth = frame.bitwidth,
                                                   .soundmode = frame.soundmode,
                                                   .virAddr = reinterpret_cast<uint32_t *>(
-                                                      frameData.data()),
+                                                      reframeBuffer.data()),
                                                   .phyAddr = frame.phyAddr,
                                                   .timeStamp = audio_ts,
                                                   .seq = frame.seq,
@@ -198,6 +308,8 @@ void AudioWorker::run()
                                                      << global_audio[encChn]->aiChn
                                                      << ", &frame) failed");
                 }
+
+                global_audio[encChn]->capture_stats.record(start, pipe->depth());
             }
             else
             {
@@ -205,7 +317,7 @@ void AudioWorker::run()
                                                       << " POLLING TIMEOUT");
             }
         }
-        else if (cfg->audio.input_enabled && !global_restart)
+        else if (snap->audio.input_enabled && !global_restart)
         {
             std::unique_lock<std::mutex> lock_stream{mutex_main};
             global_audio[encChn]->active = false;
@@ -231,6 +343,12 @@ void AudioWorker::run()
             usleep(250 * 1000);
         }
     }
+
+    if (encoding)
+    {
+        encoding = false;
+        pthread_join(encoderThread, nullptr);
+    }
 }
 
 void *AudioWorker::thread_entry(void *arg)
@@ -1,10 +1,14 @@
 #ifndef AUDIO_WORKER_HPP
 #define AUDIO_WORKER_HPP
 
+#include "AudioPipe.hpp"
 #include "AudioReframer.hpp"
 #include "IMPAudio.hpp"
 
+#include <atomic>
 #include <memory>
+#include <pthread.h>
+#include <vector>
 
 #if defined(AUDIO_SUPPORT)
 
@@ -20,9 +24,18 @@ private:
     void run();
     void process_audio_frame(IMPAudioFrame &frame);
     void process_frame(IMPAudioFrame &frame);
+    void encode_run();
+    static void *encoder_entry(void *arg);
 
     int encChn;
     std::unique_ptr<AudioReframer> reframer;
+    // grow to the largest frame once, reused for every frame
+    std::vector<uint8_t> reframeBuffer;
+
+    // PCM from the capture to the encoder thread
+    std::unique_ptr<AudioPipe> pipe;
+    std::atomic<bool> encoding{false};
+    pthread_t encoderThread{};
 };
 
 #endif // AUDIO_SUPPORT
@@ -2,6 +2,7 @@
 
 #include "IMPBackchannel.hpp"
 #include "Logger.hpp"
+#include "WorkerUtils.hpp"
 
 #include <cassert>
 #include <cmath>
@@ -9,6 +10,7 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/wait.h>
 #include <imp/imp_audio.h>
 
 #define MODULE "BackchannelWorker"
@@ -17,6 +19,7 @@ BackchannelWorker::BackchannelWorker()
     : currentSessionId(0)
     , fPipe(nullptr)
     , fPipeFd(-1)
+    , fPipePid(-1)
 {}
 
 BackchannelWorker::~BackchannelWorker()
@@ -74,10 +77,35 @@ bool BackchannelWorker::initPipe()
         return true;
     }
     LOG_DEBUG("Opening pipe to: /bin/iac -s");
-    fPipe = popen("/bin/iac -s", "w");
+    // popen() would pass on the blocked SIGINT and SIGTERM of this thread
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        LOG_ERROR("pipe failed: " << strerror(errno));
+        fPipeFd = -1;
+        return false;
+    }
+
+    char *const argv[] = {(char *)"/bin/iac", (char *)"-s", nullptr};
+    fPipePid = WorkerUtils::spawn("/bin/iac", argv, fds[0]);
+    int err = errno;
+    close(fds[0]);
+    if (fPipePid == -1)
+    {
+        LOG_ERROR("spawn failed: " << strerror(err));
+        close(fds[1]);
+        fPipeFd = -1;
+        return false;
+    }
+
+    fPipe = fdopen(fds[1], "w");
     if (fPipe == nullptr)
     {
-        LOG_ERROR("popen failed: " << strerror(errno));
+        LOG_ERROR("fdopen failed: " << strerror(errno));
+        // the child sees the end of its input and exits
+        close(fds[1]);
+        waitpid(fPipePid, nullptr, 0);
+        fPipePid = -1;
         fPipeFd = -1;
         return false;
     }
@@ -114,22 +142,25 @@ void BackchannelWorker::closePipe()
     if (fPipe)
     {
         LOG_DEBUG("Closing pipe (fd=" << fPipeFd << ").");
-        int ret = pclose(fPipe);
+        fclose(fPipe);
+        int status = 0;
+        int ret = waitpid(fPipePid, &status, 0);
         fPipe = nullptr;
         fPipeFd = -1;
+        fPipePid = -1;
         if (ret == -1)
         {
-            LOG_ERROR("pclose() failed: " << strerror(errno));
+            LOG_ERROR("waitpid() failed: " << strerror(errno));
         }
         else
         {
-            if (WIFEXITED(ret))
+            if (WIFEXITED(status))
             {
-                LOG_DEBUG("Pipe process exited with status: " << WEXITSTATUS(ret));
+                LOG_DEBUG("Pipe process exited with status: " << WEXITSTATUS(status));
             }
-            else if (WIFSIGNALED(ret))
+            else if (WIFSIGNALED(status))
             {
-                LOG_WARN("Pipe process terminated by signal: " << WTERMSIG(ret));
+                LOG_WARN("Pipe process terminated by signal: " << WTERMSIG(status));
             }
             else
             {
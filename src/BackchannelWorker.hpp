@@ -9,6 +9,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <sys/types.h>
 
 class BackchannelWorker
 {
@@ -39,6 +40,7 @@ private:
 
     FILE *fPipe;
     int fPipeFd;
+    pid_t fPipePid;
 
     BackchannelWorker(const BackchannelWorker &) = delete;
     BackchannelWorker &operator=(const BackchannelWorker &) = delete;
@@ -109,6 +109,7 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
 #endif
         {"stream0.enabled", stream0.enabled, true, validateBool},
         {"stream0.allow_shared", stream0.allow_shared, true, validateBool},
+        {"stream0.idle_idr", stream0.idle_idr, false, validateBool},
         {"stream0.osd.enabled", stream0.osd.enabled, true, validateBool},
         {"stream0.osd.logo_enabled", stream0.osd.logo_enabled, true, validateBool},
         {"stream0.osd.time_enabled", stream0.osd.time_enabled, true, validateBool},
@@ -119,6 +120,7 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
 #endif
         {"stream1.enabled", stream1.enabled, true, validateBool},
         {"stream1.allow_shared", stream1.allow_shared, true, validateBool},
+        {"stream1.idle_idr", stream1.idle_idr, false, validateBool},
         {"stream1.osd.enabled", stream1.osd.enabled, true, validateBool},
         {"stream1.osd.logo_enabled", stream1.osd.logo_enabled, true, validateBool},
         {"stream1.osd.time_enabled", stream1.osd.time_enabled, true, validateBool},
@@ -144,7 +146,15 @@ std::vector<ConfigItem<const char *>> CFG::getCharItems()
             std::set<std::string> a = {"EMERGENCY", "ALERT", "CRITICAL", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"};
             return a.count(std::string(v)) == 1;
         }},
+        {"general.module_loglevels", general.module_loglevels, "", [](const char *v) {
+            return Logger::validModuleLevels(v);
+        }},
+        {"general.osd_socket", general.osd_socket, "", [](const char *v) { return strlen(v) < 108; }},
         {"motion.script_path", motion.script_path, "/usr/sbin/motion", validateCharNotEmpty},
+        {"motion.event_socket", motion.event_socket, "", [](const char *v) { return strlen(v) < 108; }},
+        {"motion.detector", motion.detector, "ivs", [](const char *v) {
+            return strcmp(v, "ivs") == 0 || strcmp(v, "software") == 0;
+        }},
         {"rtsp.name", rtsp.name, "thingino prudynt", validateCharNotEmpty},
         {"rtsp.password", rtsp.password, "thingino", validateCharNotEmpty},
         {"rtsp.username", rtsp.username, "thingino", validateCharNotEmpty},
@@ -187,6 +197,9 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
 #if defined(AUDIO_SUPPORT)
         {"audio.input_bitrate", audio.input_bitrate, 40, [](const int &v) { return v >= 6 && v <= 256; }},
         {"audio.input_sample_rate", audio.input_sample_rate, 16000, validateSampleRate},
+        {"audio.input_frame_duration", audio.input_frame_duration, 0, [](const int &v) {
+            return v == 0 || v == 10 || v == 20 || v == 40 || v == 60;
+        }},
         {"audio.output_sample_rate", audio.output_sample_rate, 16000, validateSampleRate},
         {"audio.input_vol", audio.input_vol, 80, [](const int &v) { return v >= -30 && v <= 120; }},
         {"audio.input_gain", audio.input_gain, 25, [](const int &v) { return v >= -1 && v <= 31; }},
@@ -199,6 +212,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
 #endif
         {"general.imp_polling_timeout", general.imp_polling_timeout, 500, [](const int &v) { return v >= 1 && v <= 5000; }},
         {"general.osd_pool_size", general.osd_pool_size, 1024, [](const int &v) { return v >= 0 && v <= 65535; }},
+        {"general.osd_pool_reserve", general.osd_pool_reserve, 128, [](const int &v) { return v >= 0 && v <= 65535; }},
         {"image.ae_compensation", image.ae_compensation, 128, validateInt255},
         {"image.anti_flicker", image.anti_flicker, 2, validateInt2},
         {"image.backlight_compensation", image.backlight_compensation, 0, [](const int &v) { return v >= 0 && v <= 10; }},
@@ -227,6 +241,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"motion.min_time", motion.min_time, 1, validateIntGe0},
         {"motion.sensitivity", motion.sensitivity, 1, validateIntGe0},
         {"motion.skip_frame_count", motion.skip_frame_count, 5, validateIntGe0},
+        {"motion.detector_interval", motion.detector_interval, 200, [](const int &v) { return v >= 20 && v <= 10000; }},
         {"motion.frame_width", motion.frame_width, IVS_AUTO_VALUE, validateIntGe0},
         {"motion.frame_height", motion.frame_height, IVS_AUTO_VALUE, validateIntGe0},
         {"motion.monitor_stream", motion.monitor_stream, 1, validateInt1},
@@ -252,6 +267,12 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream0.buffers", stream0.buffers, DEFAULT_BUFFERS_0, validateInt32},
         {"stream0.fps", stream0.fps, 25, validateInt120},
         {"stream0.gop", stream0.gop, 20, validateIntGe0},
+        {"stream0.idle_fps", stream0.idle_fps, 0, [](const int &v) { return v >= 0 && v <= 120; }},
+        {"stream0.idle_bitrate", stream0.idle_bitrate, 0, validateIntGe0},
+        {"stream0.idle_gop", stream0.idle_gop, 0, validateIntGe0},
+        {"stream0.idle_delay", stream0.idle_delay, 30, validateIntGe0},
+        {"stream0.roi_qp_motion", stream0.roi_qp_motion, 0, [](const int &v) { return v >= -20 && v <= 0; }},
+        {"stream0.roi_qp_static", stream0.roi_qp_static, 0, [](const int &v) { return v >= 0 && v <= 20; }},
         {"stream0.height", stream0.height, 1080, validateIntGe0, false, "/proc/jz/sensor/height"},
         {"stream0.max_gop", stream0.max_gop, 60, validateIntGe0},
         {"stream0.osd.font_size", stream0.osd.font_size, OSD_AUTO_VALUE, validateIntGe0},
@@ -285,6 +306,12 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream1.buffers", stream1.buffers, DEFAULT_BUFFERS_1, validateInt32},
         {"stream1.fps", stream1.fps, 25, validateInt120},
         {"stream1.gop", stream1.gop, 20, validateIntGe0},
+        {"stream1.idle_fps", stream1.idle_fps, 0, [](const int &v) { return v >= 0 && v <= 120; }},
+        {"stream1.idle_bitrate", stream1.idle_bitrate, 0, validateIntGe0},
+        {"stream1.idle_gop", stream1.idle_gop, 0, validateIntGe0},
+        {"stream1.idle_delay", stream1.idle_delay, 30, validateIntGe0},
+        {"stream1.roi_qp_motion", stream1.roi_qp_motion, 0, [](const int &v) { return v >= -20 && v <= 0; }},
+        {"stream1.roi_qp_static", stream1.roi_qp_static, 0, [](const int &v) { return v >= 0 && v <= 20; }},
         {"stream1.height", stream1.height, 360, validateIntGe0},
         {"stream1.max_gop", stream1.max_gop, 60, validateIntGe0},
         {"stream1.osd.font_size", stream1.osd.font_size, OSD_AUTO_VALUE, validateIntGe0},
@@ -321,6 +348,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"websocket.loglevel", websocket.loglevel, 4096, [](const int &v) { return v > 0 && v <= 4096; }},
         {"websocket.port", websocket.port, 8089, validateInt65535},
         {"websocket.first_image_delay", websocket.first_image_delay, 100, validateInt65535},
+        {"websocket.min_push_interval", websocket.min_push_interval, 250, [](const int &v) { return v >= 50 && v <= 60000; }},
     };
 };
 
@@ -572,18 +600,41 @@ void handleConfigItem2(Config &lc, ConfigItem<T> &item)
     }
 }
 
+/* reload a single item, returns true if its value has changed.
+ * items set at runtime with noSave (auto calculated values) are kept.
+ * unchanged strings keep their previous pointer, readers may still hold it.
+ */
+template <typename T>
+bool reloadConfigItem(Config &lc, ConfigItem<T> &item)
+{
+    if (item.noSave)
+        return false;
+
+    T previous = item.value;
+    handleConfigItem(lc, item);
+
+    if constexpr (std::is_same_v<T, const char *>)
+    {
+        if (previous != nullptr && strcmp(previous, item.value) == 0)
+        {
+            free((void *)item.value);
+            item.value = previous;
+            return false;
+        }
+        return true;
+    }
+    else
+    {
+        return previous != item.value;
+    }
+}
+
 bool CFG::updateConfig()
 {
     config_loaded = readConfig();
 
-    for (auto &item : boolItems)
-        handleConfigItem2(lc, item);
-    for (auto &item : charItems)
-        handleConfigItem2(lc, item);
-    for (auto &item : intItems)
-        handleConfigItem2(lc, item);
-    for (auto &item : uintItems)
-        handleConfigItem2(lc, item);
+    for (auto &item : items)
+        std::visit([this](auto &i) { handleConfigItem2(lc, i); }, item);
 
     Setting &root = lc.getRoot();
 
@@ -599,6 +650,12 @@ bool CFG::updateConfig()
         entry.add(Setting::TypeInt) = motion.rois[i].p0_y;
         entry.add(Setting::TypeInt) = motion.rois[i].p1_x;
         entry.add(Setting::TypeInt) = motion.rois[i].p1_y;
+        if (motion.rois[i].has_options())
+        {
+            entry.add(Setting::TypeInt) = motion.rois[i].sensitivity;
+            entry.add(Setting::TypeInt) = motion.rois[i].debounce_time;
+            entry.add(Setting::TypeInt) = motion.rois[i].cooldown_time;
+        }
     }
 
     lc.writeFile(filePath);
@@ -609,26 +666,107 @@ bool CFG::updateConfig()
 
 CFG::CFG()
 {
+    buildIndex();
     load();
 }
 
+CFG::~CFG()
+{
+    for (const CFGSnapshot *snap : retired)
+        delete snap;
+    delete current.load();
+}
+
+void CFG::buildIndex()
+{
+    auto add = [this](auto &&list) {
+        for (auto &item : list)
+            items.emplace_back(std::move(item));
+    };
+    add(getBoolItems());
+    add(getCharItems());
+    add(getIntItems());
+    add(getUintItems());
+
+    index.reserve(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        std::string_view path = std::visit([](auto &item) { return std::string_view(item.path); }, items[i]);
+        if (!index.emplace(path, i).second)
+        {
+            LOG_ERROR("duplicate config item " << std::string(path));
+        }
+    }
+}
+
 void CFG::load()
 {
-    boolItems = getBoolItems();
-    charItems = getCharItems();
-    intItems = getIntItems();
-    uintItems = getUintItems();
+    reload();
+}
+
+void CFG::publish()
+{
+    std::lock_guard lock(write_lock);
+
+    CFGSnapshot *next = new CFGSnapshot{
+#if defined(AUDIO_SUPPORT)
+        audio,
+#endif
+        general, image, stream0, stream1, motion};
+
+    const CFGSnapshot *prev = current.exchange(next);
+    if (prev)
+        retired.push_back(prev);
+
+    // free the replaced snapshots no reader holds anymore, the others wait for a later publish
+    std::erase_if(retired, [this](const CFGSnapshot *snap) {
+        for (const std::atomic<const CFGSnapshot *> &slot : readers)
+        {
+            if (slot.load() == snap)
+                return false;
+        }
+        delete snap;
+        return true;
+    });
+}
+
+bool CFG::setRoi(int index, const roi &region)
+{
+    std::lock_guard lock(write_lock);
+
+    if (index < 0 || index >= (int)motion.rois.size())
+        return false;
+
+    motion.rois[index] = region;
+    publish();
+    return true;
+}
+
+void CFG::setRoiCount(int count)
+{
+    std::lock_guard lock(write_lock);
+    motion.roi_count = count;
+    publish();
+}
+
+/* read the config file and apply it to the current values.
+ * returns the paths of all items that have changed, "rois" stands for the
+ * motion roi list.
+ */
+std::vector<std::string> CFG::reload()
+{
+    std::lock_guard lock(write_lock);
+    std::vector<std::string> changed;
 
     config_loaded = readConfig();
 
-    for (auto &item : boolItems)
-        handleConfigItem(lc, item);
-    for (auto &item : charItems)
-        handleConfigItem(lc, item);
-    for (auto &item : intItems)
-        handleConfigItem(lc, item);
-    for (auto &item : uintItems)
-        handleConfigItem(lc, item);
+    for (auto &item : items)
+    {
+        std::visit([&](auto &i) {
+            if (reloadConfigItem(lc, i))
+                changed.emplace_back(i.path);
+        }, item);
+    }
 
     if (stream2.jpeg_channel == 0)
     {
@@ -650,14 +788,31 @@ void CFG::load()
         {
             if (rois.exists("roi_" + std::to_string(i)))
             {
-                if (rois[i].getLength() == 4)
+                if (rois[i].getLength() == ROI_VALUES || rois[i].getLength() == ROI_VALUES_MAX)
                 {
-                    motion.rois[i].p0_x = rois[i][0];
-                    motion.rois[i].p0_y = rois[i][1];
-                    motion.rois[i].p1_x = rois[i][2];
-                    motion.rois[i].p1_y = rois[i][3];
+                    roi r;
+                    r.p0_x = rois[i][0];
+                    r.p0_y = rois[i][1];
+                    r.p1_x = rois[i][2];
+                    r.p1_y = rois[i][3];
+                    if (rois[i].getLength() == ROI_VALUES_MAX)
+                    {
+                        r.sensitivity = rois[i][4];
+                        r.debounce_time = rois[i][5];
+                        r.cooldown_time = rois[i][6];
+                    }
+                    if (r != motion.rois[i])
+                    {
+                        if (changed.empty() || changed.back() != "rois")
+                            changed.emplace_back("rois");
+                        motion.rois[i] = r;
+                    }
                 }
             }
         }
     }
+
+    publish();
+
+    return changed;
 }
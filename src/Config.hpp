@@ -3,11 +3,19 @@
 #include <set>
 #include <atomic>
 #include <chrono>
+#include <mutex>
 #include <iostream>
 #include <functional>
 #include <libconfig.h++>
 #include <sys/time.h>
 #include <any>
+#include <array>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 //~65k
 #define ENABLE_LOG_DEBUG
@@ -66,13 +74,27 @@
     #define DEFAULT_TEMPER_VALIDATE validateInt50_150
 #endif
 
+/* motion region. the optional values override the motion settings
+ * for this region, -1 uses them.
+ */
 struct roi{
     int p0_x;
     int p0_y;
     int p1_x;
     int p1_y;
+    int sensitivity{-1};
+    int debounce_time{-1};
+    int cooldown_time{-1};
+
+    bool operator==(const roi &) const = default;
+    // the optional values are stored only if one is set
+    bool has_options() const { return sensitivity >= 0 || debounce_time >= 0 || cooldown_time >= 0; }
 };
 
+// values of a roi entry in the config and the API, 4 or all of them
+#define ROI_VALUES 4
+#define ROI_VALUES_MAX 7
+
 template<typename T>
 struct ConfigItem {
     const char *path;
@@ -83,10 +105,23 @@ struct ConfigItem {
     const char *procPath = nullptr;
 };
 
+// one entry of the config registry, all supported value types
+using ConfigItemVariant = std::variant<ConfigItem<bool>, ConfigItem<const char *>,
+                                       ConfigItem<int>, ConfigItem<unsigned int>>;
+
+template <typename T>
+inline constexpr bool is_config_type_v =
+    std::is_same_v<T, bool> || std::is_same_v<T, const char *> ||
+    std::is_same_v<T, int> || std::is_same_v<T, unsigned int>;
+
+/* runtime stats of a stream, written by its worker. they are kept with
+ * the stream in globals.hpp, not in the config sections, so snapshots
+ * don't copy them.
+ */
 struct _stream_stats {
-    uint32_t bps;
-	uint8_t fps;
-	struct timeval ts;
+    uint32_t bps{0};
+	uint8_t fps{0};
+	struct timeval ts{};
 };
 
 struct _regions {
@@ -97,8 +132,12 @@ struct _regions {
 };
 struct _general {
     const char *loglevel;
+    const char *module_loglevels;
     int osd_pool_size;
+    // KB added to an automatic pool size for the regions of the API
+    int osd_pool_reserve;
     int imp_polling_timeout;
+    const char *osd_socket;
 };
 struct _rtsp {
     int port;
@@ -156,6 +195,7 @@ struct _audio {
     int input_bitrate;
     int input_gain;
     int input_sample_rate;
+    int input_frame_duration;
 #if defined(LIB_AUDIO_PROCESSING)
     int input_alc_gain;
     int input_noise_suppression;
@@ -207,8 +247,6 @@ struct _osd {
     unsigned int font_color;
     unsigned int font_stroke_color;
     _regions regions;
-    _stream_stats stats;
-    std::atomic<int> thread_signal;
 };  
 struct _stream {
     int gop;
@@ -236,8 +274,18 @@ struct _stream {
     int jpeg_channel;
     int jpeg_idle_fps;
     const char *jpeg_path;
+    /* economy profile while there is no motion, idle_fps 0 disables it.
+     * 0 for bitrate or gop keeps the value of the stream.
+     */
+    int idle_fps;
+    int idle_bitrate;
+    int idle_gop;
+    int idle_delay;
+    bool idle_idr;
+    // QP offsets of the encoder ROIs over motion regions with and without motion, 0 disables
+    int roi_qp_motion;
+    int roi_qp_static;
     _osd osd;
-    _stream_stats stats;
 #if defined(AUDIO_SUPPORT)    
     bool audio_enabled;
 #endif
@@ -261,6 +309,10 @@ struct _motion {
     int roi_count;
     bool enabled;
     const char *script_path;
+    const char *event_socket;
+    // "ivs" or "software", the software detector checks a frame every detector_interval ms
+    const char *detector;
+    int detector_interval;
     std::array<roi, 52> rois;
 };
 struct _websocket {
@@ -270,6 +322,7 @@ struct _websocket {
     int port;
     int loglevel;
     int first_image_delay;
+    int min_push_interval;
     const char *name;
     const char *usertoken{""};
 };
@@ -277,6 +330,53 @@ struct _sysinfo {
     const char *cpu = nullptr;
 };
 
+/* immutable copy of the sections read by the worker loops.
+ * a reader holds it through a CFGSnapshotRef for as long as it uses it,
+ * writers never touch a published one. strings are shared with the live
+ * config, replaced strings are not freed so the pointers stay valid.
+ */
+struct CFGSnapshot {
+#if defined(AUDIO_SUPPORT)
+    _audio audio;
+#endif
+    _general general;
+    _image image;
+    _stream stream0;
+    _stream stream1;
+    _motion motion;
+};
+
+// snapshots the readers of all threads can hold at the same time
+#define CFG_SNAPSHOT_READERS 32
+
+/* a snapshot held by a reader. the hazard slot it occupies keeps the
+ * writer from freeing the snapshot until the reference is gone.
+ */
+class CFGSnapshotRef {
+    public:
+        CFGSnapshotRef(const CFGSnapshotRef &) = delete;
+        CFGSnapshotRef &operator=(const CFGSnapshotRef &) = delete;
+        CFGSnapshotRef(CFGSnapshotRef &&other) noexcept : snap(other.snap), slot(other.slot) {
+            other.snap = nullptr;
+            other.slot = nullptr;
+        }
+        ~CFGSnapshotRef() {
+            if (slot)
+                slot->store(nullptr, std::memory_order_release);
+        }
+
+        const CFGSnapshot *operator->() const { return snap; }
+        const CFGSnapshot &operator*() const { return *snap; }
+        const CFGSnapshot *get() const { return snap; }
+
+    private:
+        friend class CFG;
+        CFGSnapshotRef(const CFGSnapshot *snap, std::atomic<const CFGSnapshot *> *slot) : snap(snap), slot(slot) {}
+
+        const CFGSnapshot *snap;
+        std::atomic<const CFGSnapshot *> *slot;
+};
+
 class CFG {
 	public:
 
@@ -285,7 +385,9 @@ class CFG {
         std::string filePath{};
 
 		CFG();
+        ~CFG();
         void load();
+        std::vector<std::string> reload();
         static CFG *createNew();
         bool readConfig();
         bool updateConfig();
@@ -304,64 +406,92 @@ class CFG {
         _websocket websocket{};
         _sysinfo sysinfo{};
 
+    /* items are looked up by their path through a hash index that is built
+     * once, lookups don't allocate. unknown paths or a wrong type return nullptr.
+     */
     template <typename T>
-    T get(const std::string &name) {
-        T result = T{};
-        std::vector<ConfigItem<T>> *items = nullptr;
-        if constexpr (std::is_same_v<T, bool>) {
-            items = &boolItems;
-        } else if constexpr (std::is_same_v<T, const char*>) {
-            items = &charItems;
-        } else if constexpr (std::is_same_v<T, int>) {
-            items = &intItems;
-        } else if constexpr (std::is_same_v<T, unsigned int>) {
-            items = &uintItems;
-        } else {
-            return result;
+    ConfigItem<T> *find(std::string_view name) {
+        if constexpr (is_config_type_v<T>) {
+            auto it = index.find(name);
+            if (it != index.end()) {
+                return std::get_if<ConfigItem<T>>(&items[it->second]);
+            }
         }
-        for (auto &item : *items) {
-            if (item.path == name) {
-                return item.value;
+        return nullptr;
+    }
+
+    template <typename T>
+    T get(std::string_view name) {
+        if constexpr (is_config_type_v<T>) {
+            if (ConfigItem<T> *item = find<T>(name)) {
+                return item->value;
             }
         }
-        return result;
+        return T{};
     }
 
     template <typename T>
-    bool set(const std::string &name, T value, bool noSave = false) {
+    bool set(std::string_view name, T value, bool noSave = false) {
         //std::cout << name << "=" << value << std::endl;
-        std::vector<ConfigItem<T>> *items = nullptr;
-        if constexpr (std::is_same_v<T, bool>) {
-            items = &boolItems;
-        } else if constexpr (std::is_same_v<T, const char*>) {
-            items = &charItems;
-        } else if constexpr (std::is_same_v<T, int>) {
-            items = &intItems;
-        } else if constexpr (std::is_same_v<T, unsigned int>) {
-            items = &uintItems;
-        } else {
-            return false;
+        if constexpr (is_config_type_v<T>) {
+            std::lock_guard lock(write_lock);
+            ConfigItem<T> *item = find<T>(name);
+            if (item && item->validate(value)) {
+                item->value = value;
+                item->noSave = noSave;
+                publish();
+                return true;
+            }
         }
-        for (auto &item : *items) {
-            if (item.path == name) {
-                if (item.validate(value)) {
-                    item.value = value;
-                    item.noSave = noSave;
-                    return true;
-                } else {
-                    return false;
+        return false;
+    }
+
+    /* current snapshot, never nullptr after construction. lock-free, the
+     * reader claims a free hazard slot, publishes the pointer in it and
+     * checks that it's still current, so the writer sees the slot before
+     * it frees the snapshot.
+     */
+    CFGSnapshotRef snapshot() const {
+        for (;;) {
+            for (std::atomic<const CFGSnapshot *> &slot : readers) {
+                const CFGSnapshot *snap = current.load();
+                const CFGSnapshot *expected = nullptr;
+                if (!slot.compare_exchange_strong(expected, snap))
+                    continue;
+                while (snap != current.load()) {
+                    snap = current.load();
+                    slot.store(snap);
                 }
+                return CFGSnapshotRef(snap, &slot);
             }
+            // all slots held, only with more readers than CFG_SNAPSHOT_READERS
+            std::this_thread::yield();
         }
-        return false;
     }
 
+    /* copy the live values into a new snapshot and make it current.
+     * needs to be called after writing config members directly.
+     */
+    void publish();
+
+    // replace a motion roi or the roi count of the live config and publish it
+    bool setRoi(int index, const roi &region);
+    void setRoiCount(int count);
+
     private:
 
-        std::vector<ConfigItem<bool>> boolItems{};
-        std::vector<ConfigItem<const char *>> charItems{};
-        std::vector<ConfigItem<int>> intItems{};
-        std::vector<ConfigItem<unsigned int>> uintItems{};
+        // unified item table, built once in the constructor
+        std::vector<ConfigItemVariant> items{};
+        std::unordered_map<std::string_view, size_t> index{};
+        void buildIndex();
+
+        // serializes writers, readers only use the snapshot
+        std::recursive_mutex write_lock;
+        std::atomic<const CFGSnapshot *> current{nullptr};
+        // hazard slots of the readers, nullptr if free
+        mutable std::array<std::atomic<const CFGSnapshot *>, CFG_SNAPSHOT_READERS> readers{};
+        // replaced snapshots a reader may still hold, freed by publish()
+        std::vector<const CFGSnapshot *> retired{};
 
         std::vector<ConfigItem<bool>> getBoolItems();
         std::vector<ConfigItem<const char *>> getCharItems() ;
@@ -1,9 +1,13 @@
 #include "ConfigWatcher.hpp"
 
 #include "Config.hpp"
+#include "IMPSystem.hpp"
 #include "Logger.hpp"
 #include "globals.hpp"
 
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
 
@@ -12,6 +16,39 @@
 #define EVENT_SIZE (sizeof(struct inotify_event))
 #define EVENT_BUF_LEN (1024 * (EVENT_SIZE + 16))
 
+// an editor save can cause several events, reload when it's quiet for this time
+#define RELOAD_DEBOUNCE_MS 500
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+// retry interval while a replaced file doesn't exist yet
+#define WATCH_RETRY_MS 250
+
+// settings that are read at runtime by their subsystem, no restart needed
+static const char *const live_osd_keys[] = {
+    "time_format", "uptime_format", "user_text_format",
+    "pos_time_x", "pos_time_y", "pos_uptime_x", "pos_uptime_y",
+    "pos_user_text_x", "pos_user_text_y",
+    "time_rotation", "uptime_rotation", "user_text_rotation"};
+
+static const char *const live_motion_keys[] = {
+    "debounce_time", "post_time", "cooldown_time", "min_time", "init_time",
+    "script_path", "ivs_polling_timeout", "detector_interval"};
+
+// motion profile of the encoder, set by the video worker
+static const char *const live_stream_keys[] = {
+    "idle_fps", "idle_bitrate", "idle_gop", "idle_delay", "idle_idr",
+    "roi_qp_motion", "roi_qp_static"};
+
+template <size_t N>
+static bool is_one_of(const std::string &key, size_t offset, const char *const (&keys)[N])
+{
+    for (const char *k : keys)
+    {
+        if (key.compare(offset, std::string::npos, k) == 0)
+            return true;
+    }
+    return false;
+}
+
 ConfigWatcher::ConfigWatcher()
 {
     LOG_DEBUG("ConfigWatcher created.");
@@ -42,6 +79,106 @@ void *ConfigWatcher::thread_entry(void *arg)
     return nullptr;
 }
 
+void ConfigWatcher::reload()
+{
+    std::vector<std::string> changed = cfg->reload();
+    if (changed.empty())
+    {
+        LOG_DEBUG("Config file saved without changes.");
+        return;
+    }
+
+    LOG_INFO("Config file changed, " << changed.size() << " setting(s) reloaded from: " << cfg->filePath);
+    apply(changed);
+}
+
+/* hand every changed setting to its owning subsystem. settings that are read
+ * at runtime take effect right away, ISP tunings are applied in place and
+ * everything else triggers the narrowest worker restart.
+ */
+void ConfigWatcher::apply(const std::vector<std::string> &changed)
+{
+    bool image = false;
+    bool restart_rtsp = false;
+    bool restart_video = false;
+    bool restart_audio = false;
+
+    for (const std::string &key : changed)
+    {
+        LOG_DEBUG("changed: " << key);
+
+        if (key == "image.running_mode")
+        {
+#if !defined(NO_TUNINGS)
+            int ret = IMP_ISP_Tuning_SetISPRunningMode((IMPISPRunningMode)cfg->image.running_mode);
+            LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetISPRunningMode(" << cfg->image.running_mode << ")");
+#endif
+        }
+        else if (key.starts_with("image."))
+        {
+            image = true;
+        }
+        else if (key == "general.loglevel")
+        {
+            Logger::setLevel(cfg->general.loglevel);
+        }
+        else if (key == "general.module_loglevels")
+        {
+            Logger::setModuleLevels(cfg->general.module_loglevels);
+        }
+        else if (key.starts_with("stream0.osd.") || key.starts_with("stream1.osd."))
+        {
+            if (!is_one_of(key, sizeof("stream0.osd.") - 1, live_osd_keys))
+                restart_video = true;
+        }
+        else if (key.starts_with("motion."))
+        {
+            if (!is_one_of(key, sizeof("motion.") - 1, live_motion_keys))
+                restart_video = true;
+        }
+        else if ((key.starts_with("stream0.") || key.starts_with("stream1.")) &&
+                 is_one_of(key, sizeof("stream0.") - 1, live_stream_keys))
+        {
+            // applied by the video worker
+        }
+        else if (key.starts_with("stream") || key == "rois")
+        {
+            restart_video = true;
+        }
+        else if (key.starts_with("audio."))
+        {
+            restart_audio = true;
+        }
+        else if (key.starts_with("rtsp."))
+        {
+            // the rtsp server holds the sources of all streams
+            restart_rtsp = restart_video = restart_audio = true;
+        }
+        else if (key.starts_with("sensor.") || key.starts_with("websocket.") ||
+                 key == "general.osd_pool_size")
+        {
+            LOG_WARN(key << " changed, prudynt must be restarted to apply it.");
+        }
+    }
+
+    if (image)
+    {
+        IMPSystem::apply_image_tunings();
+        LOG_INFO("Image settings applied.");
+    }
+
+    if (restart_rtsp || restart_video || restart_audio)
+    {
+        std::unique_lock lck(mutex_main);
+        global_restart_rtsp |= restart_rtsp;
+        global_restart_video |= restart_video;
+        global_restart_audio |= restart_audio;
+        global_cv_worker_restart.notify_one();
+        LOG_INFO("Restart threads. rtsp:" << restart_rtsp << ", video:" << restart_video
+                                          << ", audio:" << restart_audio);
+    }
+}
+
 void ConfigWatcher::watch_using_notify()
 {
     int inotifyFd = inotify_init();
@@ -51,9 +188,7 @@ void ConfigWatcher::watch_using_notify()
         return;
     }
 
-    int watchDescriptor = inotify_add_watch(inotifyFd,
-                                            cfg->filePath.c_str(),
-                                            IN_MODIFY | IN_ALL_EVENTS);
+    int watchDescriptor = inotify_add_watch(inotifyFd, cfg->filePath.c_str(), WATCH_EVENTS);
     if (watchDescriptor == -1)
     {
         LOG_ERROR("inotify_add_watch() failed");
@@ -74,19 +209,44 @@ void ConfigWatcher::watch_using_notify()
             break;
         }
 
-        int i = 0;
-        while (i < length)
+        /* wait until the file is quiet, editors write in several chunks or
+         * replace the file. all events until then result in one reload
+         */
+        bool replaced = false;
+        struct pollfd pfd = {inotifyFd, POLLIN, 0};
+        do
         {
-            struct inotify_event *event = (struct inotify_event *) &buffer[i];
-
-            if (event->mask & IN_MODIFY)
+            for (int i = 0; i < length;)
             {
-                cfg->load();
-                LOG_INFO("Config file changed, the config is reloaded from: " << cfg->filePath);
+                struct inotify_event *event = (struct inotify_event *) &buffer[i];
+                if (event->wd == watchDescriptor &&
+                    (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)))
+                    replaced = true;
+                i += EVENT_SIZE + event->len;
             }
+            length = 0;
+            if (poll(&pfd, 1, RELOAD_DEBOUNCE_MS) > 0)
+                length = read(inotifyFd, buffer, EVENT_BUF_LEN);
+        } while (length > 0);
+
+        // the watched file was replaced (rename on save), watch the new one
+        if (replaced)
+        {
+            inotify_rm_watch(inotifyFd, watchDescriptor);
 
-            i += EVENT_SIZE + event->len;
+            // an editor may unlink the file before it creates the new one
+            int attempts = 0;
+            while ((watchDescriptor = inotify_add_watch(inotifyFd, cfg->filePath.c_str(), WATCH_EVENTS)) == -1)
+            {
+                if (attempts++ == 0)
+                    LOG_WARN("inotify_add_watch() failed, retrying: " << strerror(errno));
+                usleep(WATCH_RETRY_MS * 1000);
+            }
+            if (attempts)
+                LOG_INFO("Monitoring file for changes again: " << cfg->filePath);
         }
+
+        reload();
     }
 
     inotify_rm_watch(inotifyFd, watchDescriptor);
@@ -110,8 +270,7 @@ void ConfigWatcher::watch_using_poll()
             else if (fileInfo.st_mtime != lastModifiedTime)
             {
                 lastModifiedTime = fileInfo.st_mtime;
-                cfg->load();
-                LOG_INFO("Config file changed, the config is reloaded from: " << cfg->filePath);
+                reload();
             }
         }
 
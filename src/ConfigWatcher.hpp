@@ -1,6 +1,9 @@
 #ifndef CONFIG_WATCHER_HPP
 #define CONFIG_WATCHER_HPP
 
+#include <string>
+#include <vector>
+
 class ConfigWatcher
 {
 public:
@@ -13,6 +16,9 @@ private:
     void run();
     void watch_using_notify();
     void watch_using_poll();
+
+    void reload();
+    void apply(const std::vector<std::string> &changed);
 };
 
 #endif // CONFIG_WATCHER_HPP
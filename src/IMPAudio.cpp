@@ -6,7 +6,8 @@
 
 #define MODULE "IMPAUDIO"
 
-static thread_local IMPAudioEncoder *encoder = nullptr;
+// set by init on the audio thread, called by IMP on the encoder thread
+static IMPAudioEncoder *encoder = nullptr;
 
 static int openEncoder(void* attr, void* enc)
 {
@@ -111,6 +112,17 @@ int IMPAudio::init()
 
     // sample points per frame
     ioattr.numPerFrm = (int)ioattr.samplerate * frameDuration;
+    ai_frame_samples = ioattr.numPerFrm;
+
+    // AAC codes 1024 samples per frame, the others take the configured
+    // packet duration. longer packets lower the packet rate, shorter ones
+    // the latency.
+    if (format == IMPAudioFormat::AAC)
+        enc_frame_samples = 1024;
+    else if (cfg->audio.input_frame_duration > 0)
+        enc_frame_samples = (int)ioattr.samplerate * cfg->audio.input_frame_duration / 1000;
+    else
+        enc_frame_samples = ai_frame_samples;
 
     if (encoder)
     {
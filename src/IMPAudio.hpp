@@ -49,6 +49,10 @@ public:
     int inChn{};
     int aeChn{};
     int outChnCnt = 1;
+    // samples per channel of an AI frame, the AI channel is mono
+    int ai_frame_samples{};
+    // samples per channel handed to the encoder, reframed if they differ
+    int enc_frame_samples{};
 
 private:
     bool enabledAgc = false;
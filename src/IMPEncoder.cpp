@@ -24,6 +24,67 @@ void IMPEncoder::flush(int encChn)
     IMP_Encoder_FlushStream(encChn);
 }
 
+int IMPEncoder::setRate(int fps, int bitrate, int gop)
+{
+    IMPEncoderFrmRate frmRate{(uint32_t)fps, 1};
+    int ret = IMP_Encoder_SetChnFrmRate(encChn, &frmRate);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnFrmRate(" << encChn << ", " << fps << ")");
+
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+    int r;
+    // FIXQP has no bitrate
+    if (strcmp(stream->mode, "FIXQP") != 0)
+    {
+        r = IMP_Encoder_SetChnBitRate(encChn, bitrate, bitrate);
+        LOG_DEBUG_OR_ERROR(r, "IMP_Encoder_SetChnBitRate(" << encChn << ", " << bitrate << ")");
+        ret |= r;
+    }
+
+    r = IMP_Encoder_SetChnGopLength(encChn, gop);
+    LOG_DEBUG_OR_ERROR(r, "IMP_Encoder_SetChnGopLength(" << encChn << ", " << gop << ")");
+    ret |= r;
+#else
+    // the older encoders change the rate control only when the channel is created
+    LOG_DEBUG("bitrate and gop of channel " << encChn << " are kept");
+#endif
+
+    return ret;
+}
+
+bool IMPEncoder::canChangeBitrate()
+{
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+    return true;
+#else
+    return false;
+#endif
+}
+
+int IMPEncoder::setRoi(int index, const roi *rect, int qp)
+{
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+    IMPEncoderROIAttr attr{};
+    attr.u32Index = index;
+    attr.bEnable = rect != nullptr;
+    attr.bRelatedQp = true;
+    attr.s32Qp = qp;
+    if (rect)
+    {
+        attr.rect.p0.x = rect->p0_x;
+        attr.rect.p0.y = rect->p0_y;
+        attr.rect.p1.x = rect->p1_x;
+        attr.rect.p1.y = rect->p1_y;
+    }
+
+    int ret = IMP_Encoder_SetChnROI(encChn, &attr);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnROI(" << encChn << ", " << index << ", " << qp << ")");
+    return ret;
+#else
+    // the ROI windows of the older encoders are not supported
+    return -1;
+#endif
+}
+
 void MakeTables(int q, uint8_t *lqt, uint8_t *cqt)
 {
     // Ensure q is within the expected range
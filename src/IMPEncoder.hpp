@@ -49,6 +49,12 @@ public:
     int deinit();
     int destroy();
     static void flush(int encChn);
+    // change the rate of a running channel, kbps
+    int setRate(int fps, int bitrate, int gop);
+    // setRate changes bitrate and gop too, not only the frame rate
+    static bool canChangeBitrate();
+    // relative QP of an encoder ROI window, nullptr disables the window
+    int setRoi(int index, const roi *rect, int qp);
 
     OSD *osd = nullptr;
 
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include "IMPSystem.hpp"
 #include "Config.hpp"
+#include "OSD.hpp"
 
 #define MODULE "IMP_SYSTEM"
 
@@ -38,6 +40,24 @@ int IMPSystem::init()
     LOG_DEBUG("IMPSystem::init()");
     int ret = 0;
 
+    if (cfg->general.osd_pool_size == 0)
+    {
+        // sized from the OSD settings of the streams, plus a reserve for
+        // the regions created at runtime
+        int bytes = 0;
+        if (cfg->stream0.enabled)
+            bytes += OSD::poolEstimate(cfg->stream0);
+        if (cfg->stream1.enabled)
+            bytes += OSD::poolEstimate(cfg->stream1);
+        if (bytes)
+            bytes += cfg->general.osd_pool_reserve * 1024;
+
+        // use cfg->set to set noSave, so auto values will not written to config
+        int kb = std::max((bytes + 1023) / 1024, 1);
+        cfg->set<int>("general.osd_pool_size", kb, true);
+        LOG_INFO("OSD pool size set to " << kb << " KB");
+    }
+
     ret = IMP_OSD_SetPoolSize(cfg->general.osd_pool_size * 1024);
     LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_SetPoolSize(" << (cfg->general.osd_pool_size * 1024) << ")");
 
@@ -79,6 +99,37 @@ int IMPSystem::init()
     LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_EnableTuning()");
 
 #if !defined(NO_TUNINGS)
+    apply_image_tunings();
+
+    LOG_DEBUG("ISP Tuning Defaults set");
+
+    ret = IMP_ISP_Tuning_SetSensorFPS(cfg->sensor.fps, 1);
+    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_SetSensorFPS(" << cfg->sensor.fps << ", 1)");
+
+#if defined(PLATFORM_T21)
+    //T20 T21 only set FPS if it is read after set.
+    uint32_t fps_num, fps_den;
+    ret = IMP_ISP_Tuning_GetSensorFPS(&fps_num, &fps_den);
+    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_GetSensorFPS(" << fps_num << ", " << fps_den << ")");
+#endif
+
+    // Set the ISP to DAY on launch
+    ret = IMP_ISP_Tuning_SetISPRunningMode(IMPISP_RUNNING_MODE_DAY);
+    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_SetISPRunningMode(" << IMPISP_RUNNING_MODE_DAY << ")");
+#endif // #if !defined(NO_TUNINGS)
+
+    return ret;
+}
+
+/* apply the image.* settings to the ISP, used on init and when image
+ * settings have changed on a config reload. the running mode is not part of
+ * it, the ISP starts in day mode and night mode is switched at runtime.
+ */
+void IMPSystem::apply_image_tunings()
+{
+#if !defined(NO_TUNINGS)
+    int ret = 0;
+
     ret = IMP_ISP_Tuning_SetContrast(cfg->image.contrast);
     LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetContrast(" << cfg->image.contrast << ")");
 
@@ -117,9 +168,6 @@ int IMPSystem::init()
     ret = IMP_ISP_Tuning_SetISPVflip((IMPISPTuningOpsMode)cfg->image.vflip);
     LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetISPVflip(" << cfg->image.vflip << ")");
 
-    ret = IMP_ISP_Tuning_SetISPRunningMode((IMPISPRunningMode)cfg->image.running_mode);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetISPRunningMode(" << cfg->image.running_mode << ")");
-
     ret = IMP_ISP_Tuning_SetISPBypass(IMPISP_TUNING_OPS_MODE_ENABLE);
     LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetISPBypass(" << IMPISP_TUNING_OPS_MODE_ENABLE << ")");
 
@@ -187,25 +235,7 @@ int IMPSystem::init()
     ret = IMP_ISP_Tuning_SetHiLightDepress(cfg->image.highlight_depress);
     LOG_DEBUG_OR_ERROR(ret, "IMP_ISP_Tuning_SetHiLightDepress(" << cfg->image.highlight_depress << ")");
 #endif
-
-    LOG_DEBUG("ISP Tuning Defaults set");
-
-    ret = IMP_ISP_Tuning_SetSensorFPS(cfg->sensor.fps, 1);
-    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_SetSensorFPS(" << cfg->sensor.fps << ", 1)");
-
-#if defined(PLATFORM_T21)
-    //T20 T21 only set FPS if it is read after set.
-    uint32_t fps_num, fps_den;
-    ret = IMP_ISP_Tuning_GetSensorFPS(&fps_num, &fps_den);
-    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_GetSensorFPS(" << fps_num << ", " << fps_den << ")");
-#endif
-
-    // Set the ISP to DAY on launch
-    ret = IMP_ISP_Tuning_SetISPRunningMode(IMPISP_RUNNING_MODE_DAY);
-    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_ISP_Tuning_SetISPRunningMode(" << IMPISP_RUNNING_MODE_DAY << ")");
 #endif // #if !defined(NO_TUNINGS)
-
-    return ret;
 }
 
 int IMPSystem::destroy()
@@ -43,6 +43,7 @@ public:
 
     int init();
     int destroy();
+    static void apply_image_tunings();
 
 private:
     IMPSensorInfo sinfo{};
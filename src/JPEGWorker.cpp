@@ -94,8 +94,8 @@ void JPEGWorker::run()
     unsigned long long ms{0};
 
     // Initialize timestamp for stats calculation (ensure it's set before first use)
-    gettimeofday(&global_jpeg[jpgChn]->stream->stats.ts, NULL);
-    global_jpeg[jpgChn]->stream->stats.ts.tv_sec -= 10;
+    gettimeofday(&global_jpeg[jpgChn]->stats.ts, NULL);
+    global_jpeg[jpgChn]->stats.ts.tv_sec -= 10;
 
     while (global_jpeg[jpgChn]->running)
     {
@@ -197,18 +197,18 @@ void JPEGWorker::run()
                                                   &stream); // Release stream after saving
                     }
 
-                    ms = WorkerUtils::tDiffInMs(&global_jpeg[jpgChn]->stream->stats.ts);
+                    ms = WorkerUtils::tDiffInMs(&global_jpeg[jpgChn]->stats.ts);
                     if (ms > 1000)
                     {
-                        global_jpeg[jpgChn]->stream->stats.fps = fps;
-                        global_jpeg[jpgChn]->stream->stats.bps = bps;
+                        global_jpeg[jpgChn]->stats.fps = fps;
+                        global_jpeg[jpgChn]->stats.bps = bps;
                         fps = 0;
                         bps = 0;
-                        gettimeofday(&global_jpeg[jpgChn]->stream->stats.ts, NULL);
+                        gettimeofday(&global_jpeg[jpgChn]->stats.ts, NULL);
 
                         LOG_DDEBUG("JPG " << jpgChn
-                                          << " fps: " << global_jpeg[jpgChn]->stream->stats.fps
-                                          << " bps: " << global_jpeg[jpgChn]->stream->stats.bps
+                                          << " fps: " << global_jpeg[jpgChn]->stats.fps
+                                          << " bps: " << global_jpeg[jpgChn]->stats.bps
                                           << " diff_last_image: " << diff_last_image
                                           << " request_or_overrun: " << request_or_overrun
                                           << " targetFps: " << targetFps << " ms: " << ms);
@@ -226,8 +226,8 @@ void JPEGWorker::run()
         {
             LOG_DDEBUG("JPEG LOCK" << " channel:" << jpgChn);
 
-            global_jpeg[jpgChn]->stream->stats.bps = 0;
-            global_jpeg[jpgChn]->stream->stats.fps = 0;
+            global_jpeg[jpgChn]->stats.bps = 0;
+            global_jpeg[jpgChn]->stats.fps = 0;
             targetFps = 0;
 
             std::unique_lock<std::mutex> lock_stream{mutex_main};
@@ -0,0 +1,165 @@
+#ifndef JsonWriter_hpp
+#define JsonWriter_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* Small append-only JSON writer.
+ * The output is written into a reusable buffer that keeps 'headroom' bytes in
+ * front of the payload (LWS_PRE for websocket frames), so it can be handed to
+ * lws_write without copying. The buffer only grows, after a few requests
+ * a session doesn't allocate anymore.
+ */
+class JsonWriter
+{
+public:
+    explicit JsonWriter(size_t headroom = 0, size_t capacity = 1024)
+        : headroom(headroom), len(headroom)
+    {
+        buf.resize(headroom + capacity);
+    }
+
+    void reset()
+    {
+        if (buf.size() < headroom)
+            buf.resize(headroom);
+        len = headroom;
+    }
+
+    const char *data() const { return (const char *)buf.data() + headroom; }
+    size_t size() const { return len - headroom; }
+    bool empty() const { return len == headroom; }
+
+    // exchange the backing buffer, e.g. with a send queue slot
+    void swap(std::vector<unsigned char> &other)
+    {
+        buf.swap(other);
+        reset();
+    }
+    std::vector<unsigned char> &buffer() { return buf; }
+
+    JsonWriter &append(const char *s, size_t n)
+    {
+        char *p = reserve(n);
+        memcpy(p, s, n);
+        len += n;
+        return *this;
+    }
+
+    JsonWriter &append(const char *s) { return append(s, strlen(s)); }
+
+    JsonWriter &append(char c)
+    {
+        *reserve(1) = c;
+        len++;
+        return *this;
+    }
+
+    JsonWriter &null() { return append("null", 4); }
+
+    JsonWriter &boolean(bool b) { return b ? append("true", 4) : append("false", 5); }
+
+    JsonWriter &num(int value)
+    {
+        char tmp[12];
+        char *end = tmp + sizeof(tmp);
+        char *p = end;
+        unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+        do
+        {
+            *--p = '0' + (u % 10);
+            u /= 10;
+        } while (u);
+        if (value < 0)
+            *--p = '-';
+        return append(p, end - p);
+    }
+
+    // hex number as string, same output as printf("\"%#x\"")
+    JsonWriter &hex(unsigned int value)
+    {
+        static const char digits[] = "0123456789abcdef";
+        char tmp[12];
+        char *end = tmp + sizeof(tmp);
+        char *p = end;
+        bool zero = value == 0;
+        *--p = '"';
+        do
+        {
+            *--p = digits[value & 0xf];
+            value >>= 4;
+        } while (value);
+        if (!zero)
+        {
+            *--p = 'x';
+            *--p = '0';
+        }
+        *--p = '"';
+        return append(p, end - p);
+    }
+
+    JsonWriter &str(const char *s)
+    {
+        append('"');
+        if (s)
+        {
+            const char *run = s;
+            for (; *s; s++)
+            {
+                unsigned char c = *s;
+                if (c >= 0x20 && c != '"' && c != '\\')
+                    continue;
+
+                append(run, s - run);
+                run = s + 1;
+                switch (c)
+                {
+                case '"': append("\\\"", 2); break;
+                case '\\': append("\\\\", 2); break;
+                case '\n': append("\\n", 2); break;
+                case '\r': append("\\r", 2); break;
+                case '\t': append("\\t", 2); break;
+                default:
+                {
+                    static const char digits[] = "0123456789abcdef";
+                    char esc[6] = {'\\', 'u', '0', '0', digits[c >> 4], digits[c & 0xf]};
+                    append(esc, sizeof(esc));
+                }
+                }
+            }
+            append(run, s - run);
+        }
+        return append('"');
+    }
+
+    // "key": with optional leading separator and opener, e.g. "{"
+    JsonWriter &key(bool separator, const char *k, const char *opener = "")
+    {
+        if (separator)
+            append(',');
+        str(k);
+        append(':');
+        if (*opener)
+            append(opener);
+        return *this;
+    }
+
+private:
+    char *reserve(size_t n)
+    {
+        if (len + n > buf.size())
+        {
+            size_t grow = buf.size() * 2;
+            buf.resize(grow > len + n ? grow : len + n);
+        }
+        return (char *)buf.data() + len;
+    }
+
+    std::vector<unsigned char> buf;
+    size_t headroom;
+    size_t len;
+};
+
+#endif
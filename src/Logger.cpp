@@ -1,7 +1,12 @@
+#include <algorithm>
 #include <iostream>
 #include <unistd.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
 #include <memory>
+#include <string_view>
 
 // Undefine conflicting macros from syslog.h
 #undef LOG_INFO
@@ -11,6 +16,9 @@
 
 #define MODULE "LOGGER"
 
+// idle time of the writer thread if it can't wait on the eventfd
+#define LOG_DRAIN_SLEEP 20000
+
 #include "Logger.hpp"
 
 const char *text_levels[] = {
@@ -23,93 +31,368 @@ const char *text_levels[] = {
     "INFO",
     "DEBUG"};
 
+static int parseLogLevel(std::string_view levelStr)
+{
+    for (int i = 0; i < (int)(sizeof(text_levels) / sizeof(text_levels[0])); i++)
+    {
+        if (levelStr == text_levels[i])
+            return i;
+    }
+    return -1;
+}
+
 Logger::Level stringToLogLevel(const std::string &levelStr)
 {
-    if (levelStr == "EMERGENCY")
-        return Logger::EMERGENCY;
-    if (levelStr == "ALERT")
-        return Logger::ALERT;
-    if (levelStr == "CRITICAL")
-        return Logger::CRIT;
-    if (levelStr == "ERROR")
-        return Logger::ERROR;
-    if (levelStr == "WARN")
-        return Logger::WARN;
-    if (levelStr == "NOTICE")
-        return Logger::NOTICE;
-    if (levelStr == "INFO")
-        return Logger::INFO;
-    if (levelStr == "DEBUG")
-        return Logger::DEBUG;
+    int lvl = parseLogLevel(levelStr);
     // Default level if unknown string
-    return Logger::INFO; // or any default level you prefer
+    return lvl < 0 ? Logger::INFO : (Logger::Level)lvl;
 }
 
-Logger::Level Logger::level = Logger::INFO;
+std::atomic<int> Logger::level{Logger::INFO};
+
+// modules[0] collects all files once the table is full, it has no own level
+Logger::Module Logger::modules[LOG_MAX_MODULES];
 
-std::mutex Logger::log_mtx;
+/* bounded multi producer queue, the writer thread is the only consumer.
+ * a slot is free for position pos when its seq equals pos and holds a
+ * message when seq equals pos + 1.
+ */
+struct LogEntry
+{
+    std::atomic<uint32_t> seq;
+    int level;
+    const char *file;
+    uint32_t suppressed;
+    char text[LOG_MSG_SIZE];
+};
+
+static LogEntry queue[LOG_QUEUE_SIZE];
+static std::atomic<uint32_t> queue_head{0};
+static uint32_t queue_tail = 0;
+static std::atomic<uint32_t> dropped{0};
+static std::atomic<bool> async{false};
+// the writer blocks on it while the queue is empty, producers only signal
+// when it's asleep
+static int wake_fd = -1;
+static std::atomic<bool> drain_sleeping{false};
+
+// serializes the consumers (writer thread, flush and logging before init)
+static std::mutex drain_mtx;
+// only taken to register a module, once per call site
+static std::mutex module_mtx;
+static int module_count = 1;
+
+static uint32_t monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+// the text is written as it is, whatever its length
+static void emit(int lvl, const char *file, const char *text, uint32_t suppressed)
+{
+    char prefix[64];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%s:%s]: ", text_levels[lvl], file);
+    if (prefix_len >= (int)sizeof(prefix))
+        prefix_len = sizeof(prefix) - 1;
+
+    char suffix[48] = "";
+    int suffix_len = 0;
+    if (suppressed)
+        suffix_len = snprintf(suffix, sizeof(suffix), " (%u similar messages suppressed)", suppressed);
+
+    // syslog priorities are the same as our levels
+    syslog(lvl, "%s%s%s", prefix, text, suffix);
+    std::cout.write(prefix, prefix_len);
+    std::cout.write(text, strlen(text));
+    std::cout.write(suffix, suffix_len);
+    std::cout.put('\n');
+}
+
+// caller holds drain_mtx
+static size_t drain_queue_locked()
+{
+    size_t n = 0;
+    while (true)
+    {
+        LogEntry &e = queue[queue_tail & (LOG_QUEUE_SIZE - 1)];
+        if (e.seq.load(std::memory_order_acquire) != queue_tail + 1)
+            break;
+
+        emit(e.level, e.file, e.text, e.suppressed);
+
+        e.seq.store(queue_tail + LOG_QUEUE_SIZE, std::memory_order_release);
+        queue_tail++;
+        n++;
+    }
+
+    uint32_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "log queue full, %u messages dropped", lost);
+        emit(Logger::WARN, "Logger.cpp", text, 0);
+    }
+
+    if (n || lost)
+        std::cout.flush();
+
+    return n;
+}
+
+static size_t drain_queue()
+{
+    std::lock_guard<std::mutex> lck(drain_mtx);
+    return drain_queue_locked();
+}
+
+static bool queue_empty()
+{
+    std::lock_guard<std::mutex> lck(drain_mtx);
+    LogEntry &e = queue[queue_tail & (LOG_QUEUE_SIZE - 1)];
+    return e.seq.load(std::memory_order_acquire) != queue_tail + 1 &&
+           !dropped.load(std::memory_order_relaxed);
+}
+
+static void *drain_thread(void *)
+{
+    while (true)
+    {
+        if (drain_queue())
+            continue;
+
+        if (wake_fd < 0)
+        {
+            usleep(LOG_DRAIN_SLEEP);
+            continue;
+        }
+
+        /* announce the sleep before the last look at the queue, a producer
+         * publishes before it looks at the flag. one of both sees the other
+         */
+        drain_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue_empty())
+        {
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) < 0)
+            {
+                // interrupted, look again
+            }
+        }
+        drain_sleeping.store(false, std::memory_order_relaxed);
+    }
+    return nullptr;
+}
+
+// wake the writer thread if it's waiting for messages
+static void wake_drain()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (wake_fd >= 0 && drain_sleeping.load(std::memory_order_relaxed) &&
+        drain_sleeping.exchange(false, std::memory_order_relaxed))
+    {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0)
+        {
+            // counter overflow only, the writer is woken anyway
+        }
+    }
+}
 
 bool Logger::init(std::string logLevel)
 {
     // Initialize the syslog
     openlog("prudynt", LOG_PID | LOG_NDELAY, LOG_USER);
     Logger::level = stringToLogLevel(logLevel);
+
+    for (uint32_t i = 0; i < LOG_QUEUE_SIZE; i++)
+        queue[i].seq.store(i, std::memory_order_relaxed);
+
+    // without it the writer polls
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, drain_thread, nullptr) != 0)
+    {
+        // keep logging synchronous
+        return true;
+    }
+    pthread_detach(thread);
+
+    async.store(true, std::memory_order_release);
+    atexit(Logger::flush);
+
     LOG_DEBUG("Logger Init.");
     return false;
 }
 
+void Logger::flush()
+{
+    if (async.load(std::memory_order_acquire))
+        drain_queue();
+}
+
 void Logger::setLevel(std::string lvl)
 {
     LOG_DEBUG("set loglevel to " << lvl);
     Logger::level = stringToLogLevel(lvl);
 }
 
-void Logger::log(Level lvl, std::string module, LogMsg msg)
+// module name of a source file, "WS.cpp" -> "WS"
+static std::string_view module_name(const char *file)
+{
+    std::string_view name(file);
+    size_t dot = name.find('.');
+    return dot == std::string_view::npos ? name : name.substr(0, dot);
+}
+
+// index of a module, registers it if unknown. needs module_mtx
+static int find_module(Logger::Module *modules, std::string_view name, bool add)
+{
+    for (int i = 1; i < module_count; i++)
+    {
+        if (name == modules[i].name)
+            return i;
+    }
+    if (!add || module_count == LOG_MAX_MODULES || name.size() >= sizeof(modules[0].name))
+        return 0;
+
+    memcpy(modules[module_count].name, name.data(), name.size());
+    modules[module_count].name[name.size()] = 0;
+    return module_count++;
+}
+
+int Logger::resolve(Site &site)
+{
+    std::lock_guard<std::mutex> lck(module_mtx);
+    int module = find_module(modules, module_name(site.file), true);
+    site.module.store(module, std::memory_order_relaxed);
+    return module;
+}
+
+/* walk a "Module=LEVEL,..." list, calls fn(name, level) for every entry.
+ * returns false if an entry is malformed.
+ */
+template <typename F>
+static bool parse_module_levels(const char *levels, F fn)
+{
+    std::string_view list(levels ? levels : "");
+    while (!list.empty())
+    {
+        size_t end = list.find(',');
+        std::string_view entry = list.substr(0, end);
+        list = (end == std::string_view::npos) ? std::string_view() : list.substr(end + 1);
+
+        while (!entry.empty() && entry.front() == ' ')
+            entry.remove_prefix(1);
+        while (!entry.empty() && entry.back() == ' ')
+            entry.remove_suffix(1);
+        if (entry.empty())
+            continue;
+
+        size_t eq = entry.find('=');
+        if (eq == std::string_view::npos || eq == 0 || eq >= sizeof(Logger::Module::name))
+            return false;
+
+        int lvl = parseLogLevel(entry.substr(eq + 1));
+        if (lvl < 0)
+            return false;
+
+        fn(entry.substr(0, eq), lvl);
+    }
+    return true;
+}
+
+bool Logger::validModuleLevels(const char *levels)
 {
-    std::unique_lock<std::mutex> lck(log_mtx);
+    return parse_module_levels(levels, [](std::string_view, int) {});
+}
+
+bool Logger::setModuleLevels(const char *levels)
+{
+    if (!validModuleLevels(levels))
+        return false;
 
-    // Always log to syslog regardless of level
-    int syslogPriority;
-    switch (lvl)
     {
-    case EMERGENCY:
-        syslogPriority = 0;
-        break;
-    case ALERT:
-        syslogPriority = 1;
-        break;
-    case CRIT:
-        syslogPriority = 2;
-        break;
-    case ERROR:
-        syslogPriority = 3;
-        break;
-    case WARN:
-        syslogPriority = 4;
-        break;
-    case NOTICE:
-        syslogPriority = 5;
-        break;
-    case INFO:
-        syslogPriority = 6;
-        break;
-    case DEBUG:
-        syslogPriority = 7;
-        break;
-    default:
-        syslogPriority = 7;
-        break; // Default case for undefined levels
+        std::lock_guard<std::mutex> lck(module_mtx);
+        for (int i = 1; i < module_count; i++)
+            modules[i].level.store(-1, std::memory_order_relaxed);
+
+        parse_module_levels(levels, [](std::string_view name, int lvl) {
+            int module = find_module(modules, name, true);
+            if (module)
+                modules[module].level.store(lvl, std::memory_order_relaxed);
+        });
     }
-    syslog(syslogPriority, "[%s:%s]: %s", text_levels[lvl], module.c_str(), msg.log_str.c_str());
 
-    // Filter what gets printed on the console based on the Logger::level
-    if (Logger::level >= lvl)
+    LOG_DEBUG("set module loglevels to " << levels);
+    return true;
+}
+
+bool Logger::admit(Site &site, uint32_t &suppressed)
+{
+    // rate limit per call site, the first message of a new second
+    // reports what was suppressed in the last one
+    suppressed = 0;
+    uint32_t now = monotonic_seconds();
+    uint32_t window = site.window.load(std::memory_order_relaxed);
+    if (window != now && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed))
+    {
+        site.count.store(0, std::memory_order_relaxed);
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT)
     {
-        std::stringstream fmt;
-        fmt << "[" << text_levels[lvl] << ":" << module << "]: " << msg.log_str << std::endl;
-        std::cout << fmt.str();
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
+    return true;
 }
 
-// Remember to close the syslog
-// closelog();
+void Logger::log(Level lvl, Site &site, uint32_t suppressed, LogMsg msg)
+{
+    // a message that doesn't fit a queue slot is written by the caller,
+    // after the queued ones so the order is kept
+    if (!async.load(std::memory_order_acquire) || msg.log_str.size() >= LOG_MSG_SIZE)
+    {
+        std::lock_guard<std::mutex> lck(drain_mtx);
+        drain_queue_locked();
+        emit(lvl, site.file, msg.log_str.c_str(), suppressed);
+        std::cout.flush();
+        return;
+    }
+
+    uint32_t pos = queue_head.load(std::memory_order_relaxed);
+    LogEntry *e;
+    while (true)
+    {
+        e = &queue[pos & (LOG_QUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(e->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (queue_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // queue is full, never block the caller
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            wake_drain();
+            return;
+        }
+        else
+        {
+            pos = queue_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    e->level = lvl;
+    e->file = site.file;
+    e->suppressed = suppressed;
+    memcpy(e->text, msg.log_str.c_str(), msg.log_str.size() + 1);
+
+    e->seq.store(pos + 1, std::memory_order_release);
+    wake_drain();
+}
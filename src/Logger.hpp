@@ -1,44 +1,66 @@
 #ifndef Logger_hpp
 #define Logger_hpp
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <sstream>
 #include <mutex>
+#include <sstream>
+#include <string>
 #include "Config.hpp"
 
 #define FILENAME (strrchr("/" __FILE__, '/') + 1)
-#define LOG_EMER(str) Logger::log(Logger::EMERGENCY, FILENAME, LogMsg() << str)
-#define LOG_ALER(str) Logger::log(Logger::ALERT, FILENAME, LogMsg() << str)
-#define LOG_CRIT(str) Logger::log(Logger::CRITICAL, FILENAME, LogMsg() << str)
-#define LOG_ERROR(str) Logger::log(Logger::ERROR, FILENAME, LogMsg() << str)
-#define LOG_WARN(str) Logger::log(Logger::WARN, FILENAME, LogMsg() << str)
-#define LOG_NOTICE(str) Logger::log(Logger::NOTICE, FILENAME, LogMsg() << str)
-#define LOG_INFO(str) Logger::log(Logger::INFO, FILENAME, LogMsg() << str)
+
+/* every log statement owns a static Logger::Site, the level and the rate
+ * limit are checked before the message is formatted. */
+#define LOG_AT(lvl, str)                                                        \
+    do                                                                          \
+    {                                                                           \
+        static Logger::Site log_site_{FILENAME};                                \
+        uint32_t log_suppressed_;                                               \
+        if (Logger::enabled(lvl, log_site_) && Logger::admit(log_site_, log_suppressed_)) \
+            Logger::log(lvl, log_site_, log_suppressed_, LogMsg() << str);      \
+    } while (0)
+
+#define LOG_EMER(str) LOG_AT(Logger::EMERGENCY, str)
+#define LOG_ALER(str) LOG_AT(Logger::ALERT, str)
+#define LOG_CRIT(str) LOG_AT(Logger::CRIT, str)
+#define LOG_ERROR(str) LOG_AT(Logger::ERROR, str)
+#define LOG_WARN(str) LOG_AT(Logger::WARN, str)
+#define LOG_NOTICE(str) LOG_AT(Logger::NOTICE, str)
+#define LOG_INFO(str) LOG_AT(Logger::INFO, str)
 
 #if defined(DDEBUG)
-#define LOG_DDEBUG(str) Logger::log(Logger::DEBUG, FILENAME, LogMsg() << str)
+#define LOG_DDEBUG(str) LOG_AT(Logger::DEBUG, str)
 #else
 #define LOG_DDEBUG(str) ((void)0)
 #endif
 
 #if defined(DDEBUGWS)
-#define LOG_DDEBUGWS(str) Logger::log(Logger::DEBUG, FILENAME, LogMsg() << str)
+#define LOG_DDEBUGWS(str) LOG_AT(Logger::DEBUG, str)
 #else
 #define LOG_DDEBUGWS(str) ((void)0)
 #endif
 
 #if defined(ENABLE_LOG_DEBUG)
-#define LOG_DEBUG(str) Logger::log(Logger::DEBUG, FILENAME, LogMsg() << str)
-#define LOG_DEBUG_OR_ERROR(condition, str) \
-    ((condition) == 0 ? Logger::log(Logger::DEBUG, FILENAME, LogMsg() << str) : Logger::log(Logger::ERROR, FILENAME, LogMsg() << str))
+#define LOG_DEBUG(str) LOG_AT(Logger::DEBUG, str)
+#define LOG_DEBUG_OR_ERROR(condition, str)       \
+    do                                           \
+    {                                            \
+        if ((condition) == 0)                    \
+            LOG_AT(Logger::DEBUG, str);          \
+        else                                     \
+            LOG_AT(Logger::ERROR, str);          \
+    } while (0)
 #define LOG_DEBUG_OR_ERROR_AND_EXIT(condition, str)                                            \
     if ((condition) == 0)                                                                      \
     {                                                                                          \
-        Logger::log(Logger::DEBUG, FILENAME, LogMsg() << str << " = " << condition); \
+        LOG_AT(Logger::DEBUG, str << " = " << condition);                                      \
     }                                                                                          \
     else                                                                                       \
     {                                                                                          \
-        Logger::log(Logger::ERROR, FILENAME, LogMsg() << str << " = " << condition); \
+        LOG_AT(Logger::ERROR, str << " = " << condition);                                      \
         return condition;                                                                      \
     }
 #else
@@ -47,21 +69,35 @@
 #define LOG_DEBUG_OR_ERROR_AND_EXIT(condition, str) ((void)0);
 #endif
 
+// max. messages per second and call site, the rest is counted and summarized
+#define LOG_RATE_LIMIT 10
+// queued messages, power of two
+#define LOG_QUEUE_SIZE 128
+// text of a queue slot, longer messages are written synchronously
+#define LOG_MSG_SIZE 256
+#define LOG_MAX_MODULES 64
+
 struct LogMsg
 {
     LogMsg() = default;
     std::string log_str;
-    LogMsg &operator<<(std::string a)
+    LogMsg &operator<<(const std::string &a)
     {
         log_str.append(a);
         return *this;
     }
 
+    LogMsg &operator<<(const char *a)
+    {
+        log_str.append(a ? a : "(null)");
+        return *this;
+    }
+
     LogMsg &operator<<(int a)
     {
-        std::stringstream ss;
-        ss << a;
-        log_str.append(ss.str());
+        char buf[12];
+        int n = snprintf(buf, sizeof(buf), "%d", a);
+        log_str.append(buf, n);
         return *this;
     }
 };
@@ -81,14 +117,56 @@ public:
         DEBUG
     };
 
+    /* per call site state, the module is resolved on first use.
+     * the rate limit counts messages in the current second.
+     */
+    struct Site
+    {
+        const char *file;
+        std::atomic<int> module{-1};
+        std::atomic<uint32_t> window{0};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
     static bool init(std::string logLevel);
-    static void log(Level level, std::string module, LogMsg msg);
+    /* rate limit of a call site, false if the message is suppressed.
+     * suppressed is what was dropped in the last second, reported once.
+     */
+    static bool admit(Site &site, uint32_t &suppressed);
+    static void log(Level level, Site &site, uint32_t suppressed, LogMsg msg);
+    static void flush();
+
+    static bool enabled(Level lvl, Site &site)
+    {
+        int module = site.module.load(std::memory_order_relaxed);
+        if (module < 0)
+            module = resolve(site);
+        int limit = modules[module].level.load(std::memory_order_relaxed);
+        if (limit < 0)
+            limit = level.load(std::memory_order_relaxed);
+        return lvl <= limit;
+    }
 
     static void setLevel(std::string lvl);
-    static Level level;
+    /* "Module=LEVEL,..." the module is the source file name without the
+     * extension, e.g. "WS=DEBUG,Motion=WARN". modules not listed use the
+     * global level again. returns false on a malformed list.
+     */
+    static bool setModuleLevels(const char *levels);
+    static bool validModuleLevels(const char *levels);
+    static std::atomic<int> level;
+
+    // runtime level of a module, -1 uses the global level
+    struct Module
+    {
+        char name[32];
+        std::atomic<int> level{-1};
+    };
 
 private:
-    static std::mutex log_mtx;
+    static Module modules[LOG_MAX_MODULES];
+    static int resolve(Site &site);
 };
 
 #endif
@@ -1,49 +1,58 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
 #include "Motion.hpp"
+#include "MotionEvents.hpp"
+#include "MotionStats.hpp"
 
 using namespace std::chrono;
 bool ignoreInitialPeriod = true;
 
+static MotionRegions shared_regions;
+static std::mutex regions_mutex;
+
 std::string Motion::getConfigPath(const char *itemName)
 {
     return "motion." + std::string(itemName);
 }
 
+void Motion::regions(MotionRegions &out)
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    out = shared_regions;
+}
+
+void Motion::publishRegion(int n, bool active)
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    shared_regions.active[n] = active;
+    shared_regions.version++;
+}
+
 void Motion::detect()
 {
     LOG_INFO("Start motion detection thread.");
 
-    int ret;
-    int debounce = 0;
-    IMP_IVS_MoveOutput *result;
-    bool isInCooldown = false;
-    auto cooldownEndTime = steady_clock::now();
-    auto motionEndTime = steady_clock::now();
     auto startTime = steady_clock::now();
 
     if(init() != 0) return;
 
+    MotionEvents::start();
+
     global_motion_thread_signal = true;
     while (global_motion_thread_signal)
     {
+        // config values stay the same for this iteration
+        CFGSnapshotRef snap = cfg->snapshot();
 
-        ret = IMP_IVS_PollingResult(ivsChn, cfg->motion.ivs_polling_timeout);
-        if (ret < 0)
-        {
-            LOG_WARN("IMP_IVS_PollingResult error: " << ret);
-            continue;
-        }
-
-        ret = IMP_IVS_GetResult(ivsChn, (void **)&result);
-        if (ret < 0)
-        {
-            LOG_WARN("IMP_IVS_GetResult error: " << ret);
+        int activeRoi[IMP_IVS_MOVE_MAX_ROI_CNT];
+        if (!poll(snap.get(), activeRoi))
             continue;
-        }
 
         auto currentTime = steady_clock::now();
         auto elapsedTime = duration_cast<seconds>(currentTime - startTime);
 
-        if (ignoreInitialPeriod && elapsedTime.count() < cfg->motion.init_time)
+        if (ignoreInitialPeriod && elapsedTime.count() < snap->motion.init_time)
         {
             continue;
         }
@@ -52,80 +61,170 @@ void Motion::detect()
             ignoreInitialPeriod = false;
         }
 
-        if (isInCooldown && duration_cast<seconds>(currentTime - cooldownEndTime).count() < cfg->motion.cooldown_time)
-        {
-            continue;
-        }
-        else
-        {
-            isInCooldown = false;
-        }
+        MotionStats::record(activeRoi);
 
+        // every region debounces, stops and cools down on its own
         bool motionDetected = false;
-        for (int i = 0; i < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+        for (int n = 0; n < roiCount; n++)
         {
-            if (result->retRoi[i])
+            const roi &region = snap->motion.rois[roiIndex[n]];
+            RoiState &state = roiState[n];
+            int debounceTime = region.debounce_time >= 0 ? region.debounce_time : snap->motion.debounce_time;
+            int cooldownTime = region.cooldown_time >= 0 ? region.cooldown_time : snap->motion.cooldown_time;
+
+            if (state.inCooldown)
             {
-                motionDetected = true;
-                LOG_INFO("Active motion detected in region " << i);
-                debounce++;
-                if (debounce >= cfg->motion.debounce_time)
+                if (duration_cast<seconds>(currentTime - state.cooldownEnd).count() < cooldownTime)
+                    continue;
+                state.inCooldown = false;
+            }
+
+            if (activeRoi[n])
+            {
+                state.debounce++;
+                if (state.debounce >= debounceTime)
                 {
-                    if (!moving.load())
+                    if (!state.active)
                     {
-                        moving = true;
-                        LOG_INFO("Motion Start");
-
-                        char cmd[128];
-                        memset(cmd, 0, sizeof(cmd));
-                        snprintf(cmd, sizeof(cmd), "%s start", cfg->motion.script_path);
-                        ret = system(cmd);
-                        if (ret != 0)
-                        {
-                            LOG_ERROR("Motion script failed:" << cmd);
-                        }
+                        state.active = true;
+                        publishRegion(n, true);
+                        LOG_INFO("Motion Start in region " << roiIndex[n]);
+                        MotionEvents::post(true, false, ++state.events, roiIndex[n]);
                     }
-                    indicator = true;
-                    motionEndTime = steady_clock::now(); // Update last motion time
+                    state.lastMotion = currentTime; // Update last motion time
                 }
             }
-        }
-
-        if (!motionDetected)
-        {
-            debounce = 0;
-            auto duration = duration_cast<seconds>(currentTime - motionEndTime).count();
-            if (moving && duration >= cfg->motion.min_time && duration >= cfg->motion.post_time)
+            else
             {
-                LOG_INFO("End of Motion");
-                char cmd[128];
-                memset(cmd, 0, sizeof(cmd));
-                snprintf(cmd, sizeof(cmd), "%s stop", cfg->motion.script_path);
-                ret = system(cmd);
-                if (ret != 0)
+                state.debounce = 0;
+                auto duration = duration_cast<seconds>(currentTime - state.lastMotion).count();
+                if (state.active && duration >= snap->motion.min_time && duration >= snap->motion.post_time)
                 {
-                    LOG_ERROR("Motion script failed:" << cmd);
+                    state.active = false;
+                    publishRegion(n, false);
+                    LOG_INFO("End of Motion in region " << roiIndex[n]);
+                    MotionEvents::post(false, false, ++state.events, roiIndex[n]);
+                    state.cooldownEnd = currentTime; // Start cooldown
+                    state.inCooldown = true;
                 }
-                moving = false;
-                indicator = false;
-                cooldownEndTime = steady_clock::now(); // Start cooldown
-                isInCooldown = true;
             }
+
+            motionDetected |= state.active;
         }
 
-        ret = IMP_IVS_ReleaseResult(ivsChn, (void *)result);
-        if (ret < 0)
+        // the script and the notifications follow the first start and the last stop
+        if (motionDetected && !moving)
         {
-            LOG_WARN("IMP_IVS_ReleaseResult error: " << ret);
-            continue;
+            LOG_INFO("Motion Start");
+            moving = true;
+            indicator = true;
+            global_motion_active = true;
+            MotionEvents::post(true, true, ++global_motion_events);
+        }
+        else if (!motionDetected && moving)
+        {
+            LOG_INFO("End of Motion");
+            moving = false;
+            indicator = false;
+            global_motion_active = false;
+            MotionEvents::post(false, true, ++global_motion_events);
         }
     }
 
+    for (int n = 0; n < roiCount; n++)
+    {
+        if (roiState[n].active)
+        {
+            roiState[n].active = false;
+            publishRegion(n, false);
+            MotionEvents::post(false, false, ++roiState[n].events, roiIndex[n]);
+        }
+    }
+
+    if (moving)
+    {
+        moving = false;
+        global_motion_active = false;
+        MotionEvents::post(false, false, ++global_motion_events);
+    }
+
     exit();
 
     LOG_DEBUG("Exit motion detect thread.");
 }
 
+bool Motion::poll(const CFGSnapshot *snap, int *activeRoi)
+{
+    if (software)
+        return pollSoftware(snap, activeRoi);
+
+    IMP_IVS_MoveOutput *result;
+
+    int ret = IMP_IVS_PollingResult(ivsChn, snap->motion.ivs_polling_timeout);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_PollingResult error: " << ret);
+        return false;
+    }
+
+    ret = IMP_IVS_GetResult(ivsChn, (void **)&result);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_GetResult error: " << ret);
+        return false;
+    }
+
+    // copy the regions and give the result back right away, also when it's ignored
+    for (int i = 0; i < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+        activeRoi[i] = result->retRoi[i];
+
+    ret = IMP_IVS_ReleaseResult(ivsChn, (void *)result);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_ReleaseResult error: " << ret);
+    }
+
+    return true;
+}
+
+bool Motion::pollSoftware(const CFGSnapshot *snap, int *activeRoi)
+{
+    std::this_thread::sleep_for(milliseconds(snap->motion.detector_interval));
+
+    IMPFrameInfo *frame;
+    int ret = IMP_FrameSource_GetFrame(snap->motion.monitor_stream, &frame);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_FrameSource_GetFrame error: " << ret);
+        return false;
+    }
+
+    if (kernel.width() != (int)frame->width || kernel.height() != (int)frame->height)
+        kernel.reset(frame->width, frame->height);
+
+    // the luma plane of the NV12 frame comes first
+    kernel.process((const uint8_t *)(uintptr_t)frame->virAddr, frame->width, snap->motion.sensitivity);
+
+    ret = IMP_FrameSource_ReleaseFrame(snap->motion.monitor_stream, frame);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_FrameSource_ReleaseFrame error: " << ret);
+    }
+
+    // the regions are in encoder pixels, the frame may be smaller
+    int fw = kernel.width(), fh = kernel.height();
+    int ew = std::max(snap->motion.frame_width, 1), eh = std::max(snap->motion.frame_height, 1);
+    for (int n = 0; n < roiCount; n++)
+    {
+        const IMPRect &r = move_param.roiRect[n];
+        int sensitivity = move_param.sense[n];
+        activeRoi[n] = kernel.active(r.p0.x * fw / ew, r.p0.y * fh / eh,
+                                     r.p1.x * fw / ew, r.p1.y * fh / eh, sensitivity);
+    }
+
+    return true;
+}
+
 int Motion::init()
 {
     LOG_INFO("Initialize motion detection.");
@@ -138,8 +237,12 @@ int Motion::init()
     }
     int ret;
 
-    ret = IMP_IVS_CreateGroup(0);
-    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_IVS_CreateGroup(0)");
+    software = strcmp(cfg->motion.detector, "software") == 0;
+    if (!software)
+    {
+        ret = IMP_IVS_CreateGroup(0);
+        LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_IVS_CreateGroup(0)");
+    }
 
     //automatically set frame size / height 
     ret = IMP_Encoder_GetChnAttr(cfg->motion.monitor_stream, &channelAttributes);
@@ -165,29 +268,79 @@ int Motion::init()
 
     memset(&move_param, 0, sizeof(IMP_IVS_MoveParam));
     // OSD is affecting motion for some reason.
-    // Sensitivity range is 0-4
-    move_param.sense[0] = cfg->motion.sensitivity;
+    // Sensitivity range is 0-4, set per region below
     move_param.skipFrameCnt = cfg->motion.skip_frame_count;
     move_param.frameInfo.width = cfg->motion.frame_width;
     move_param.frameInfo.height = cfg->motion.frame_height;
 
     LOG_INFO("Motion detection:" << 
-             " sensibility: " << move_param.sense[0] << 
+             " sensibility: " << cfg->motion.sensitivity << 
              ", skipCnt:" << move_param.skipFrameCnt << 
              ", width:" << move_param.frameInfo.width << 
              ", height:" << move_param.frameInfo.height);
 
-    move_param.roiRect[0].p0.x = cfg->motion.roi_0_x;
-    move_param.roiRect[0].p0.y = cfg->motion.roi_0_y;
-    move_param.roiRect[0].p1.x = cfg->motion.roi_1_x - 1;
-    move_param.roiRect[0].p1.y = cfg->motion.roi_1_y - 1;
-    move_param.roiRectCnt = cfg->motion.roi_count;
+    /* the first roi_count regions of the rois list. a first region
+     * without area uses roi_0_x .. roi_1_y, a later one is skipped.
+     */
+    roiCount = 0;
+    for (int i = 0; i < cfg->motion.roi_count && roiCount < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+    {
+        roi region = cfg->motion.rois[i];
+        if (region.p1_x <= region.p0_x || region.p1_y <= region.p0_y || region.p0_x < 0 || region.p0_y < 0)
+        {
+            if (i > 0)
+            {
+                LOG_WARN("Motion detection roi[" << i << "] has no area, ignored.");
+                continue;
+            }
+            region.p0_x = cfg->motion.roi_0_x;
+            region.p0_y = cfg->motion.roi_0_y;
+            region.p1_x = cfg->motion.roi_1_x - 1;
+            region.p1_y = cfg->motion.roi_1_y - 1;
+        }
 
-    LOG_INFO("Motion detection roi[0]:" << 
-             " roi_0_x: " << cfg->motion.roi_0_x << 
-             ", roi_0_y:" << cfg->motion.roi_0_y << 
-             ", roi_1_x: " << cfg->motion.roi_1_x << 
-             ", roi_1_y:" << cfg->motion.roi_1_y);
+        int n = roiCount++;
+        roiIndex[n] = i;
+        roiState[n] = RoiState{};
+        move_param.roiRect[n].p0.x = region.p0_x;
+        move_param.roiRect[n].p0.y = region.p0_y;
+        move_param.roiRect[n].p1.x = std::min(region.p1_x, cfg->motion.frame_width - 1);
+        move_param.roiRect[n].p1.y = std::min(region.p1_y, cfg->motion.frame_height - 1);
+        move_param.sense[n] = region.sensitivity >= 0 ? region.sensitivity : cfg->motion.sensitivity;
+
+        LOG_INFO("Motion detection roi[" << i << "]:" <<
+                 " x0: " << move_param.roiRect[n].p0.x <<
+                 ", y0: " << move_param.roiRect[n].p0.y <<
+                 ", x1: " << move_param.roiRect[n].p1.x <<
+                 ", y1: " << move_param.roiRect[n].p1.y <<
+                 ", sensibility: " << move_param.sense[n]);
+    }
+    move_param.roiRectCnt = roiCount;
+
+    {
+        std::lock_guard<std::mutex> lock(regions_mutex);
+        shared_regions.frameWidth = cfg->motion.frame_width;
+        shared_regions.frameHeight = cfg->motion.frame_height;
+        shared_regions.count = roiCount;
+        for (int n = 0; n < roiCount; n++)
+        {
+            const IMPRect &r = move_param.roiRect[n];
+            shared_regions.rect[n] = {r.p0.x, r.p0.y, r.p1.x, r.p1.y};
+            shared_regions.active[n] = false;
+        }
+        shared_regions.version++;
+    }
+    MotionStats::reset(roiIndex, roiCount);
+
+    if (software)
+    {
+        // one frame kept in the channel for IMP_FrameSource_GetFrame
+        kernel = MotionKernel{};
+        ret = IMP_FrameSource_SetFrameDepth(cfg->motion.monitor_stream, 1);
+        LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_FrameSource_SetFrameDepth(" << cfg->motion.monitor_stream << ", 1)");
+        LOG_INFO("Software motion detection every " << cfg->motion.detector_interval << "ms.");
+        return ret;
+    }
 
     move_intf = IMP_IVS_CreateMoveInterface(&move_param);
 
@@ -224,6 +377,19 @@ int Motion::exit()
 
     LOG_DEBUG("Exit motion detection.");
 
+    {
+        std::lock_guard<std::mutex> lock(regions_mutex);
+        shared_regions.count = 0;
+        shared_regions.version++;
+    }
+
+    if (software)
+    {
+        ret = IMP_FrameSource_SetFrameDepth(cfg->motion.monitor_stream, 0);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_FrameSource_SetFrameDepth(" << cfg->motion.monitor_stream << ", 0)");
+        return ret;
+    }
+
     ret = IMP_IVS_StopRecvPic(ivsChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_IVS_StopRecvPic(0)");
 
@@ -1,12 +1,15 @@
 #ifndef Motion_hpp
 #define Motion_hpp
 
+#include <chrono>
 #include <memory>
 #include <thread>
 #include <atomic>
 #include "Config.hpp"
 #include "Logger.hpp"
 #include "globals.hpp"
+#include "WS.hpp"
+#include "MotionKernel.hpp"
 #include "imp/imp_system.h"
 #include "imp/imp_ivs.h"
 #include "imp/imp_ivs_move.h"
@@ -21,18 +24,40 @@
 #define picHeight uHeight
 #endif
 
+// programmed regions and the ones with motion, in motion frame pixels
+struct MotionRegions
+{
+    // changes with every change of the regions or their state
+    unsigned int version{0};
+    int frameWidth{0};
+    int frameHeight{0};
+    int count{0};
+    roi rect[IMP_IVS_MOVE_MAX_ROI_CNT];
+    bool active[IMP_IVS_MOVE_MAX_ROI_CNT];
+};
+
 class Motion {
     public:
         void detect();
         static void *run(void* arg);
         int init();
         int exit();
+        // copy of the current regions, for the encoders
+        static void regions(MotionRegions &out);
 
     private:
         int ivsChn = 0;
         int ivsGrp = 0;
 
         std::string getConfigPath(const char *itemName);
+        static void publishRegion(int n, bool active);
+        // motion per configured region of the next result, false if there is none
+        bool poll(const CFGSnapshot *snap, int *activeRoi);
+        bool pollSoftware(const CFGSnapshot *snap, int *activeRoi);
+
+        // frames of the monitor stream instead of IVS
+        bool software = false;
+        MotionKernel kernel;
 
         std::atomic<bool> moving;
         std::atomic<bool> indicator;    
@@ -44,6 +69,21 @@ class Motion {
         IMPCell ivs_cell = {};
 
         IMPEncoderCHNAttr channelAttributes;
+
+        // state of an IVS region, each starts and stops on its own
+        struct RoiState {
+            int debounce{0};
+            bool active{false};
+            bool inCooldown{false};
+            unsigned int events{0};
+            std::chrono::steady_clock::time_point lastMotion;
+            std::chrono::steady_clock::time_point cooldownEnd;
+        };
+
+        // configured region of each IVS region
+        int roiIndex[IMP_IVS_MOVE_MAX_ROI_CNT];
+        int roiCount = 0;
+        RoiState roiState[IMP_IVS_MOVE_MAX_ROI_CNT];
 };
 
 #endif /* Motion_hpp */
@@ -0,0 +1,276 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "MotionEvents.hpp"
+#include "MsgChannel.hpp"
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "WS.hpp"
+#include "WorkerUtils.hpp"
+
+#define MODULE "MotionEvents"
+
+// poll interval while a script runs, to reap it
+#define MOTION_SCRIPT_POLL_MS 100
+// time a running script gets to finish when the dispatcher stops, in ms
+#define MOTION_SCRIPT_EXIT_TIMEOUT 5000
+
+static MsgChannel<MotionEvent> events(MOTION_EVENT_QUEUE_SIZE);
+// wakes the dispatcher, the counter never blocks the writer
+static int wake_fd = -1;
+static std::once_flag started;
+static pthread_t thread;
+static bool running = false;
+static std::atomic<bool> stopping{false};
+
+void MotionEvents::start()
+{
+    std::call_once(started, [] {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0)
+        {
+            LOG_ERROR("eventfd: " << strerror(errno));
+            return;
+        }
+
+        int ret = pthread_create(&thread, nullptr, dispatch, nullptr);
+        LOG_DEBUG_OR_ERROR(ret, "create motion event thread");
+        running = ret == 0;
+    });
+}
+
+static void wake()
+{
+    if (wake_fd >= 0)
+    {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0)
+        {
+            // counter overflow only, the dispatcher is woken anyway
+        }
+    }
+}
+
+void MotionEvents::stop()
+{
+    if (!running)
+        return;
+
+    stopping = true;
+    wake();
+    pthread_join(thread, nullptr);
+    running = false;
+}
+
+void MotionEvents::post(bool active, bool script, unsigned int count, int roi)
+{
+    MotionEvent event{active, script, count, {}, roi};
+    clock_gettime(CLOCK_REALTIME, &event.time);
+
+    if (!events.write(event))
+        LOG_WARN("Motion event queue full, oldest event dropped.");
+
+    wake();
+}
+
+static int listen_socket(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("Motion event socket: " << strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, MOTION_EVENT_MAX_CLIENTS) < 0)
+    {
+        LOG_ERROR("Motion event socket " << path << ": " << strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    LOG_INFO("Motion events on " << path);
+    return fd;
+}
+
+/* a plain path is run without a shell, one without a #! line by /bin/sh.
+ * a script_path with arguments goes to /bin/sh -c, like system() did.
+ */
+static pid_t spawn_script(const char *path, const char *action)
+{
+    pid_t pid;
+    if (strpbrk(path, " \t"))
+    {
+        std::string cmd = std::string(path) + " " + action;
+        char *const argv[] = {(char *)"sh", (char *)"-c", (char *)cmd.c_str(), nullptr};
+        pid = WorkerUtils::spawn("/bin/sh", argv);
+    }
+    else
+    {
+        char *const argv[] = {(char *)path, (char *)action, nullptr};
+        pid = WorkerUtils::spawn(path, argv);
+        if (pid == -1 && errno == ENOEXEC)
+        {
+            char *const sh_argv[] = {(char *)"sh", (char *)path, (char *)action, nullptr};
+            pid = WorkerUtils::spawn("/bin/sh", sh_argv);
+        }
+    }
+
+    if (pid == -1)
+        LOG_ERROR("Motion script failed: " << path << " " << action << ": " << strerror(errno));
+    return pid;
+}
+
+void *MotionEvents::dispatch(void *arg)
+{
+    int clients[MOTION_EVENT_MAX_CLIENTS];
+    int client_count = 0;
+
+    /* only one script runs at a time. events during a run are coalesced
+     * to the latest state, it runs afterwards if it differs from the state
+     * the script has reported last.
+     */
+    bool script_pending = false;
+    bool pending_active = false;
+    pid_t script_pid = -1;
+    bool script_active = false;
+
+    // the socket is opened once, a changed path needs a restart
+    int listen_fd = -1;
+    if (cfg->motion.event_socket[0])
+        listen_fd = listen_socket(cfg->motion.event_socket);
+
+    while (true)
+    {
+        struct pollfd fds[2] = {{wake_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}};
+        int ret = poll(fds, listen_fd >= 0 ? 2 : 1, script_pid > 0 ? MOTION_SCRIPT_POLL_MS : -1);
+        if (ret < 0 && errno != EINTR)
+        {
+            LOG_ERROR("poll: " << strerror(errno));
+            break;
+        }
+
+        // taken before the queue is read, events posted before stop() are delivered
+        bool last = stopping;
+
+        if (listen_fd >= 0 && (fds[1].revents & POLLIN))
+        {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                if (client_count < MOTION_EVENT_MAX_CLIENTS)
+                    clients[client_count++] = fd;
+                else
+                    close(fd);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) < 0)
+            {
+                // already drained
+            }
+        }
+
+        MotionEvent event;
+        while (events.read(&event))
+        {
+            // the websocket reports the motion of the whole image
+            if (event.roi < 0)
+                WS::notify();
+
+            char roi[16] = "";
+            if (event.roi >= 0)
+                snprintf(roi, sizeof(roi), "\"roi\":%d,", event.roi);
+
+            char line[112];
+            int len = snprintf(line, sizeof(line), "{\"motion\":%s,%s\"events\":%u,\"time\":%lld.%03ld}\n",
+                               event.active ? "true" : "false", roi, event.count,
+                               (long long)event.time.tv_sec, event.time.tv_nsec / 1000000);
+
+            // a client that can't keep up is dropped, never waited for
+            for (int i = 0; i < client_count;)
+            {
+                if (send(clients[i], line, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len)
+                {
+                    LOG_DEBUG("Motion event client dropped.");
+                    close(clients[i]);
+                    clients[i] = clients[--client_count];
+                    continue;
+                }
+                i++;
+            }
+
+            if (event.script)
+            {
+                script_pending = true;
+                pending_active = event.active;
+            }
+        }
+
+        if (script_pid > 0)
+        {
+            int status;
+            if (waitpid(script_pid, &status, WNOHANG) == script_pid)
+            {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                {
+                    LOG_ERROR("Motion script failed: " << cfg->snapshot()->motion.script_path << " "
+                                                       << (script_active ? "start" : "stop"));
+                }
+                script_pid = -1;
+            }
+        }
+
+        if (script_pid <= 0 && script_pending)
+        {
+            script_pending = false;
+            if (pending_active != script_active)
+            {
+                script_active = pending_active;
+                script_pid = spawn_script(cfg->snapshot()->motion.script_path, script_active ? "start" : "stop");
+            }
+        }
+
+        if (last)
+            break;
+    }
+
+    for (int i = 0; i < client_count; i++)
+        close(clients[i]);
+    if (listen_fd >= 0)
+        close(listen_fd);
+
+    // the last script may just have been started, give it some time to finish
+    for (int waited = 0; script_pid > 0; waited += MOTION_SCRIPT_POLL_MS)
+    {
+        if (waitpid(script_pid, nullptr, WNOHANG) == script_pid)
+            break;
+        if (waited >= MOTION_SCRIPT_EXIT_TIMEOUT)
+        {
+            LOG_WARN("Motion script still running at shutdown, pid " << script_pid);
+            break;
+        }
+        usleep(MOTION_SCRIPT_POLL_MS * 1000);
+    }
+
+    return nullptr;
+}
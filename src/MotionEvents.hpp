@@ -0,0 +1,44 @@
+#ifndef MotionEvents_hpp
+#define MotionEvents_hpp
+
+#include <ctime>
+
+// events waiting for the dispatcher, the oldest are dropped
+#define MOTION_EVENT_QUEUE_SIZE 32
+// clients of the event socket
+#define MOTION_EVENT_MAX_CLIENTS 8
+
+struct MotionEvent
+{
+    bool active;
+    // run the motion script, not done for the stop at shutdown
+    bool script;
+    unsigned int count;
+    struct timespec time;
+    // configured motion region, -1 for the motion of the whole image
+    int roi;
+};
+
+/* motion events are handed to a dispatcher thread, the detection loop
+ * never waits for a handler. the dispatcher
+ *  - runs the motion script with posix_spawn, one at a time. events during
+ *    a run are coalesced to the latest state
+ *  - writes a JSON line per event to the clients of motion.event_socket
+ *  - wakes the websocket server for the motion subscribers
+ * the script only runs for the whole image, the regions are reported on the socket.
+ */
+class MotionEvents
+{
+public:
+    // starts the dispatcher once
+    static void start();
+    // delivers the queued events and ends the dispatcher, at shutdown
+    static void stop();
+    // never blocks. count is per region for the events of a region
+    static void post(bool active, bool script, unsigned int count, int roi = -1);
+
+private:
+    static void *dispatch(void *arg);
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstring>
+#include "MotionKernel.hpp"
+
+// initial noise of a block, a mean difference of 2 x16
+#define MOTION_KERNEL_NOISE 32
+
+/* threshold per sensitivity 0-4, the noise factor x4 and the minimum level
+ * x16. low sensitivity needs a larger change above the noise.
+ */
+static const int noise_factor[] = {24, 16, 12, 8, 6};
+static const int min_level[] = {96, 64, 48, 40, 32};
+
+// background blend, 1/8 of the difference for still blocks and 1/64 for moving ones
+#define MOTION_KERNEL_STILL_SHIFT 3
+#define MOTION_KERNEL_MOVING_SHIFT 6
+
+void MotionKernel::reset(int width, int height)
+{
+    frameWidth = width;
+    frameHeight = height;
+    blocksX = (width + MOTION_KERNEL_BLOCK - 1) / MOTION_KERNEL_BLOCK;
+    blocksY = (height + MOTION_KERNEL_BLOCK - 1) / MOTION_KERNEL_BLOCK;
+    background.assign((size_t)width * height, 0);
+    level.assign((size_t)blocksX * blocksY, 0);
+    noise.assign((size_t)blocksX * blocksY, MOTION_KERNEL_NOISE);
+    primed = false;
+}
+
+bool MotionKernel::moving(int block, int sensitivity) const
+{
+    sensitivity = std::clamp(sensitivity, 0, 4);
+    int threshold = std::max<int>(min_level[sensitivity], noise[block] * noise_factor[sensitivity] / 4);
+    return level[block] > threshold;
+}
+
+/* the row loops work on plain byte arrays without branches so the compiler
+ * can vectorize them, e.g. with -O2 -ftree-vectorize and NEON or MXU.
+ */
+static uint32_t row_sad(const uint8_t *cur, const uint8_t *bg, int n)
+{
+    uint32_t sad = 0;
+    for (int x = 0; x < n; x++)
+        sad += (uint32_t)std::abs((int)cur[x] - (int)bg[x]);
+    return sad;
+}
+
+// rounded away from zero, every difference moves the background by at least 1
+static void row_blend(const uint8_t *cur, uint8_t *bg, int n, int shift)
+{
+    int round = (1 << shift) - 1;
+    for (int x = 0; x < n; x++)
+    {
+        int d = (int)cur[x] - (int)bg[x];
+        int sign = (d > 0) - (d < 0);
+        bg[x] = (uint8_t)(bg[x] + (d + sign * round) / (1 << shift));
+    }
+}
+
+int MotionKernel::process(const uint8_t *luma, int stride, int sensitivity)
+{
+    if (!primed)
+    {
+        for (int y = 0; y < frameHeight; y++)
+            memcpy(&background[(size_t)y * frameWidth], luma + (size_t)y * stride, frameWidth);
+        primed = true;
+        return 0;
+    }
+
+    int count = 0;
+    for (int by = 0; by < blocksY; by++)
+    {
+        int y0 = by * MOTION_KERNEL_BLOCK;
+        int h = std::min(MOTION_KERNEL_BLOCK, frameHeight - y0);
+
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            int x0 = bx * MOTION_KERNEL_BLOCK;
+            int w = std::min(MOTION_KERNEL_BLOCK, frameWidth - x0);
+            int block = by * blocksX + bx;
+
+            uint32_t sad = 0;
+            for (int y = y0; y < y0 + h; y++)
+                sad += row_sad(luma + (size_t)y * stride + x0, &background[(size_t)y * frameWidth + x0], w);
+            level[block] = (uint16_t)std::min<uint32_t>(sad * 16 / (w * h), UINT16_MAX);
+
+            bool move = moving(block, sensitivity);
+            if (move)
+            {
+                count++;
+            }
+            else
+            {
+                // the noise follows the level of a still block
+                noise[block] = (uint16_t)std::max(MOTION_KERNEL_NOISE / 4,
+                                                  noise[block] + ((level[block] - noise[block]) >> 4));
+            }
+
+            int shift = move ? MOTION_KERNEL_MOVING_SHIFT : MOTION_KERNEL_STILL_SHIFT;
+            for (int y = y0; y < y0 + h; y++)
+                row_blend(luma + (size_t)y * stride + x0, &background[(size_t)y * frameWidth + x0], w, shift);
+        }
+    }
+    return count;
+}
+
+bool MotionKernel::active(int x0, int y0, int x1, int y1, int sensitivity) const
+{
+    if (!primed)
+        return false;
+
+    int bx0 = std::clamp(x0, 0, frameWidth - 1) / MOTION_KERNEL_BLOCK;
+    int by0 = std::clamp(y0, 0, frameHeight - 1) / MOTION_KERNEL_BLOCK;
+    int bx1 = std::clamp(x1, 0, frameWidth - 1) / MOTION_KERNEL_BLOCK;
+    int by1 = std::clamp(y1, 0, frameHeight - 1) / MOTION_KERNEL_BLOCK;
+
+    for (int by = by0; by <= by1; by++)
+    {
+        for (int bx = bx0; bx <= bx1; bx++)
+        {
+            if (moving(by * blocksX + bx, sensitivity))
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,46 @@
+#ifndef MotionKernel_hpp
+#define MotionKernel_hpp
+
+#include <cstdint>
+#include <vector>
+
+// pixels of a block side, the blocks at the right and bottom edge may be smaller
+#define MOTION_KERNEL_BLOCK 16
+
+/* software motion detection on the luma plane of small frames, without
+ * IMP dependencies so it builds and runs on the host.
+ *
+ * every block compares the frame with an adaptive background image. the
+ * mean absolute difference of a block is its level, a block moves when the
+ * level is above a multiple of the noise seen in that block while it was
+ * still. the background follows still blocks quickly and moving ones slowly,
+ * so an object that stops becomes background after a while.
+ */
+class MotionKernel
+{
+public:
+    // a frame of another size starts over with it as background
+    void reset(int width, int height);
+    // luma plane of a NV12 frame, returns the blocks with motion at the given sensitivity (0-4)
+    int process(const uint8_t *luma, int stride, int sensitivity);
+    // motion in a block that overlaps the rectangle, p1 inclusive, frame pixels
+    bool active(int x0, int y0, int x1, int y1, int sensitivity) const;
+
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+
+private:
+    bool moving(int block, int sensitivity) const;
+
+    int frameWidth{0};
+    int frameHeight{0};
+    int blocksX{0};
+    int blocksY{0};
+    bool primed{false};
+    std::vector<uint8_t> background;
+    // mean absolute difference of the last frame and noise floor per block, x16
+    std::vector<uint16_t> level;
+    std::vector<uint16_t> noise;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <mutex>
+#include "MotionStats.hpp"
+
+static MotionStatsBucket second_buckets[MOTION_STATS_SECONDS];
+static MotionStatsBucket minute_buckets[MOTION_STATS_MINUTES];
+static int roi_count = 0;
+static int roi_index[IMP_IVS_MOVE_MAX_ROI_CNT];
+static std::mutex stats_mutex;
+
+static int64_t now_seconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// bucket of a time, a bucket of an older time is reused
+static MotionStatsBucket &bucket(MotionStatsBucket *ring, int size, int64_t time)
+{
+    MotionStatsBucket &b = ring[time % size];
+    if (b.time != time)
+        b = MotionStatsBucket{time};
+    return b;
+}
+
+static void add(MotionStatsBucket &b, const int *activeRoi)
+{
+    if (b.frames == UINT16_MAX)
+        return;
+    b.frames++;
+    for (int n = 0; n < roi_count; n++)
+    {
+        if (activeRoi[n])
+            b.active[n]++;
+    }
+}
+
+void MotionStats::reset(const int *roiIndex, int roiCount)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    for (auto &b : second_buckets)
+        b = MotionStatsBucket{};
+    for (auto &b : minute_buckets)
+        b = MotionStatsBucket{};
+    roi_count = roiCount;
+    for (int n = 0; n < roiCount; n++)
+        roi_index[n] = roiIndex[n];
+}
+
+void MotionStats::record(const int *activeRoi)
+{
+    int64_t now = now_seconds();
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    add(bucket(second_buckets, MOTION_STATS_SECONDS, now), activeRoi);
+    add(bucket(minute_buckets, MOTION_STATS_MINUTES, now / 60), activeRoi);
+}
+
+void MotionStats::heatmap(MotionHeatmap &map)
+{
+    int64_t now = now_seconds();
+    map = MotionHeatmap{};
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    map.roiCount = roi_count;
+    for (int n = 0; n < roi_count; n++)
+        map.roiIndex[n] = roi_index[n];
+
+    // the current bucket is partial, the windows are the last 60 seconds and 60 minutes
+    auto sum = [&map](const MotionStatsBucket *ring, int size, int64_t current, int window) {
+        for (int i = 0; i < size; i++)
+        {
+            const MotionStatsBucket &b = ring[i];
+            if (b.time < 0 || b.time > current || b.time <= current - size)
+                continue;
+            map.frames[window] += b.frames;
+            for (int n = 0; n < map.roiCount; n++)
+                map.active[n][window] += b.active[n];
+        }
+    };
+    sum(second_buckets, MOTION_STATS_SECONDS, now, 0);
+    sum(minute_buckets, MOTION_STATS_MINUTES, now / 60, 1);
+}
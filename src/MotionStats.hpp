@@ -0,0 +1,43 @@
+#ifndef MotionStats_hpp
+#define MotionStats_hpp
+
+#include <cstdint>
+#include "imp/imp_ivs.h"
+#include "imp/imp_ivs_move.h"
+
+// sliding windows of the activity counts, one bucket per second or minute
+#define MOTION_STATS_SECONDS 60
+#define MOTION_STATS_MINUTES 60
+
+struct MotionStatsBucket
+{
+    // second or minute of the steady clock the counts belong to
+    int64_t time{-1};
+    // IVS results in this bucket and how many of them had motion per configured region
+    uint16_t frames{0};
+    uint16_t active[IMP_IVS_MOVE_MAX_ROI_CNT]{};
+};
+
+// activity of the configured regions over the last minute and hour
+struct MotionHeatmap
+{
+    int roiCount;
+    int roiIndex[IMP_IVS_MOVE_MAX_ROI_CNT];
+    unsigned int frames[2];
+    unsigned int active[IMP_IVS_MOVE_MAX_ROI_CNT][2];
+};
+
+/* counts of the IVS results per region, written by the motion thread for
+ * every result and read by the API. the counts replace a log line per
+ * active frame for tuning the regions and their sensitivity.
+ */
+class MotionStats
+{
+public:
+    // new regions, the counts start over
+    static void reset(const int *roiIndex, int roiCount);
+    static void record(const int *activeRoi);
+    static void heatmap(MotionHeatmap &map);
+};
+
+#endif
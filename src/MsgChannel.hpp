@@ -2,7 +2,7 @@
 #define MsgChannel_hpp
 
 #include <iostream>
-#include <deque>
+#include <vector>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -10,18 +10,24 @@
 
 /* Implementation of the MsgChannel API, except that it keeps 
  * the most recent bsize elements in the queue.
+ * the slots are allocated once and messages are moved in and out, a
+ * write or read does no heap work of its own.
  */
 template <class T> class MsgChannel {
 public:
-    MsgChannel(unsigned int bsize) : buffer_size{bsize} { }
+    MsgChannel(unsigned int bsize) : slots(bsize + 1), buffer_size{bsize} { }
 
     bool write(T msg) {
         std::unique_lock<std::mutex> lck(cv_mtx);
-        msg_buffer.push_front(msg);
-        if (msg_buffer.size() > buffer_size) {
-            msg_buffer.pop_back();
+        slots[tail] = std::move(msg);
+        tail = next(tail);
+        if (count == buffer_size) {
+            // the oldest message is dropped
+            slots[head] = T{};
+            head = next(head);
             return false;
         }
+        count++;
         write_cv.notify_all();
         return true;
     }
@@ -29,29 +35,46 @@ public:
     bool read(T *out) {
         std::unique_lock<std::mutex> lck(cv_mtx);
         if (can_read()) {
-            *out = msg_buffer.back();
-            msg_buffer.pop_back();
+            *out = pop();
             return true;
         }
         return false;
     }
 
+    size_t size() {
+        std::unique_lock<std::mutex> lck(cv_mtx);
+        return count;
+    }
+
     T wait_read() {
         std::unique_lock<std::mutex> lck(cv_mtx);
         while (!can_read()) {
             write_cv.wait(lck);
         };
-        T val = msg_buffer.back();
-        msg_buffer.pop_back();
-        return val;
+        return pop();
     }
 
 private:
     bool can_read() {
-        return !msg_buffer.empty();
+        return count > 0;
+    }
+
+    size_t next(size_t i) const {
+        return (i + 1) % slots.size();
+    }
+
+    T pop() {
+        T val = std::move(slots[head]);
+        head = next(head);
+        count--;
+        return val;
     }
 
-    std::deque<T> msg_buffer;
+    // one spare slot, a write stores before it drops the oldest
+    std::vector<T> slots;
+    size_t head{0};
+    size_t tail{0};
+    size_t count{0};
     std::mutex cv_mtx;
     std::condition_variable write_cv;
     unsigned int buffer_size;
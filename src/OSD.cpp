@@ -1,8 +1,11 @@
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include "OSD.hpp"
 #include "Config.hpp"
 #include <pthread.h>
+#include <ctime>
 #include "Logger.hpp"
 #include "globals.hpp"
 #include <unistd.h>
@@ -25,282 +28,74 @@
 #include <vector>
 #include <fstream>
 
-#include "schrift.h"
-
-int OSD::renderGlyph(const char *characters)
+/* bitmap of an item in the shared font. streams with the same font, format
+ * and rotation get the same bitmap, user text with per stream values not.
+ * the lookup is only repeated if one of them has changed.
+ */
+OSDBitmap &OSD::item_bitmap(OSDItem *osdItem, char kind, const char *format, int angle)
 {
-
-    while (*characters)
+    if (osd.font_stroke != font->stroke())
     {
-
-        SFT_LMetrics lmetrics;
-        SFT_GMetrics gmetrics;
-        SFT_Glyph glyph;
-        SFT_Image imageBuffer;
-
-        if (sft_lmetrics(sft, &lmetrics) == 0 && sft_lookup(sft, *characters, &glyph) == 0)
-        {
-            if (sft_gmetrics(sft, glyph, &gmetrics) == 0)
-            {
-                imageBuffer.width = gmetrics.minWidth;
-                imageBuffer.height = gmetrics.minHeight;
-                imageBuffer.pixels = (uint8_t *)malloc(imageBuffer.width * imageBuffer.height);
-
-                if (sft_render(sft, glyph, imageBuffer) == 0)
-                {
-                    Glyph g;
-                    g.width = imageBuffer.width;
-                    g.height = imageBuffer.height;
-                    g.advance = gmetrics.advanceWidth;
-                    g.xmin = gmetrics.leftSideBearing;
-                    g.ymin = gmetrics.yOffset;
-                    g.glyph = glyph;
-
-                    g.bitmap.resize(g.width * g.height * 4);
-                    for (int y = 0; y < g.height; ++y)
-                    {
-                        for (int x = 0; x < g.width; ++x)
-                        {
-                            int pixelIndex = y * g.width + x;
-                            uint8_t alpha = ((uint8_t *)imageBuffer.pixels)[pixelIndex];
-                            if (alpha > 0)
-                            {
-                                g.bitmap[pixelIndex * 4] = BGRA_TEXT[0];
-                                g.bitmap[pixelIndex * 4 + 1] = BGRA_TEXT[1];
-                                g.bitmap[pixelIndex * 4 + 2] = BGRA_TEXT[2];
-                                g.bitmap[pixelIndex * 4 + 3] = alpha;
-                            }
-                        }
-                    }
-
-                    glyphs[*characters] = g;
-                }
-                free(imageBuffer.pixels);
-            }
-        }
-        ++characters;
+        if (auto f = OSDFont::get(osd))
+            font = f;
     }
 
-    return 0;
-}
-
-void setPixel(uint8_t *image, int x, int y, const uint8_t *color, int WIDTH, int HEIGHT)
-{
-    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
+    if (osdItem->bitmap == nullptr || osdItem->font != font.get() ||
+        osdItem->format != format || osdItem->angle != angle)
     {
-        int index = (y * WIDTH + x) * 4;
-        image[index] = color[0];     // B
-        image[index + 1] = color[1]; // G
-        image[index + 2] = color[2]; // R
-        image[index + 3] = color[3]; // A
+        std::string key = std::string(1, kind) + ":" + std::to_string(angle) + ":" + format;
+        if (kind == 'u' && (strstr(format, "%fps") || strstr(format, "%bps")))
+            key += std::string(":") + parent;
+
+        osdItem->bitmap = &font->bitmap(key);
+        osdItem->font = font.get();
+        osdItem->format = format;
+        osdItem->angle = angle;
+        osdItem->serial = osdItem->bitmap->serial - 1;
     }
-}
 
-void OSD::drawOutline(uint8_t* image, const Glyph& g, int x, int y, int outlineSize, int WIDTH, int HEIGHT) {
-    for (int j = -outlineSize; j <= outlineSize; ++j) {
-        for (int i = -outlineSize; i <= outlineSize; ++i) {
-            if (i * i + j * j <= outlineSize * outlineSize) { // Use circular distance
-                for (int h = 0; h < g.height; ++h) {
-                    for (int w = 0; w < g.width; ++w) {
-                        int srcIndex = (h * g.width + w) * 4;
-                        if (g.bitmap[srcIndex + 3] > 0) { // Check alpha value
-                            setPixel(image, x + w + i, y + h + j, BGRA_STROKE, WIDTH, HEIGHT);
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-/*
-void OSD::drawOutline(uint8_t *image, const Glyph &g, int x, int y, int outlineSize, int WIDTH, int HEIGHT)
-{
-    for (int j = -outlineSize; j <= outlineSize; ++j)
-    {
-        for (int i = -outlineSize; i <= outlineSize; ++i)
-        {
-            if (abs(i) + abs(j) <= outlineSize)
-            { // Use Manhattan distance
-                for (int h = 0; h < g.height; ++h)
-                {
-                    for (int w = 0; w < g.width; ++w)
-                    {
-                        int srcIndex = (h * g.width + w) * 4;
-                        if (g.bitmap[srcIndex + 3] > 0)
-                        { // Check alpha value
-                            setPixel(image, x + w + i, y + h + j, BGRA_STROKE, WIDTH, HEIGHT);
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-*/
-int OSD::drawText(uint8_t *image, const char *text, int WIDTH, int HEIGHT, int outlineSize)
-{
-    int penX = 1;
-    int penY = 1;
-
-    // Draw text and outline
-    while (*text)
-    {
-        auto it = glyphs.find(*text);
-        if (it != glyphs.end())
-        {
-            const Glyph &g = it->second;
-
-            int x = penX + g.xmin + outlineSize;
-            int y = penY + (sft->yScale + g.ymin);
-
-            // Draw the outline
-            drawOutline(image, g, x, y, outlineSize, WIDTH, HEIGHT);
-
-            // Draw the actual text
-            for (int j = 0; j < g.height; ++j)
-            {
-                for (int i = 0; i < g.width; ++i)
-                {
-                    int srcIndex = (j * g.width + i) * 4;
-                    if (g.bitmap[srcIndex + 3] > 0)
-                    { // Check alpha value
-                        setPixel(image, x + i, y + j, &g.bitmap[srcIndex], WIDTH, HEIGHT);
-                    }
-                }
-            }
-
-            penX += g.advance + (outlineSize * 2);
-        }
-        ++text;
-    }
-
-    return 0;
+    return *osdItem->bitmap;
 }
 
-int OSD::calculateTextSize(const char *text, uint16_t &width, uint16_t &height, int outlineSize)
+// hand the bitmap to the region, skipped if it shows it already
+void OSD::show(OSDItem *osdItem, IMPOSDRgnAttr *irgnAttr, int posX, int posY)
 {
-    width = 0;
-    height = 0;
+    OSDBitmap &bitmap = *osdItem->bitmap;
+    if (irgnAttr == nullptr && bitmap.serial == osdItem->serial)
+        return;
+    osdItem->serial = bitmap.serial;
 
-    while (*text)
-    {
-        auto it = glyphs.find(*text);
-        if (it != glyphs.end())
-        {
-            const Glyph &g = it->second;
-
-            width += g.advance + (outlineSize * 2);
-            if (g.height > height)
-            {
-                height = g.height;
-            }
-        }
-
-        ++text;
-    }
-
-    height += sft->yScale;
-    width += 1 + outlineSize;
-
-    return 0;
-}
-
-int OSD::libschrift_init()
-{
-    LOG_DEBUG("OSD::libschrift_init()");
-
-    std::ifstream fontFile(osd.font_path, std::ios::binary | std::ios::ate);
-    if (!fontFile.is_open())
-    {
-        LOG_DEBUG("Unable to open font file.");
-        return -1;
-    }
-
-    BGRA_TEXT[2] = (osd.font_color >> 16) & 0xFF;
-    BGRA_TEXT[1] = (osd.font_color >> 8) & 0xFF;
-    BGRA_TEXT[0] = (osd.font_color >> 0) & 0xFF;
-    BGRA_TEXT[3] = 0;
-
-    BGRA_STROKE[2] = (osd.font_stroke_color >> 16) & 0xFF;
-    BGRA_STROKE[1] = (osd.font_stroke_color >> 8) & 0xFF;
-    BGRA_STROKE[0] = (osd.font_stroke_color >> 0) & 0xFF;
-    BGRA_STROKE[3] = 255;
-
-    size_t fileSize = fontFile.tellg();
-    std::vector<uint8_t> fontData;
-    fontFile.seekg(0, std::ios::beg);
-    fontData.resize(fileSize);
-    fontFile.read(reinterpret_cast<char *>(fontData.data()), fileSize);
-    fontFile.close();
-
-    sft = new SFT();
-    sft->flags = SFT_DOWNWARD_Y;
-    sft->xScale = osd.font_size * osd.font_xscale / 100;
-    sft->yScale = osd.font_size * osd.font_yscale / 100;
-    sft->yOffset = osd.font_yoffset;
-    sft->font = sft_loadmem(fontData.data(), fontData.size());
-    if (!sft->font)
-    {
-        LOG_DEBUG("Unable to load font data.");
-        return -1;
-    }
-
-    renderGlyph("01234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!§$%&/()=?,.-_:;#'+*~}{} ");
-
-    fontData.clear();
-    return 0;
-}
-
-void OSD::set_text(OSDItem *osdItem, IMPOSDRgnAttr *irgnAttr, const char *text, int posX, int posY, int angle)
-{
-
-    // size and stroke
-    uint8_t stroke_width = osd.font_stroke;
-    uint16_t item_width = 0;
-    uint16_t item_height = 0;
-
-    calculateTextSize(text, item_width, item_height, stroke_width);
-
-    if (item_width % 2 != 0)
-        ++item_width;
-
-    int item_size = item_width * item_height * 4;
-
-    free(osdItem->data);
-    osdItem->data = (uint8_t *)malloc(item_size);
-    memset(osdItem->data, 0, item_size);
-
-    drawText(osdItem->data, text, item_width, item_height, stroke_width);
-
-    if (angle)
-    {
-        rotateBGRAImage(osdItem->data, item_width, item_height, angle, true);
-    }
-
-    if (item_width != osdItem->width || item_height != osdItem->height)
+    if (bitmap.width != osdItem->width || bitmap.height != osdItem->height)
     {
         if (irgnAttr == nullptr)
         {
             IMP_OSD_GetRgnAttr(osdItem->imp_rgn, &osdItem->rgnAttr);
         }
 
-        set_pos(&osdItem->rgnAttr, posX, posY, item_width, item_height, stream_width, stream_height);
+        set_pos(&osdItem->rgnAttr, posX, posY, bitmap.width, bitmap.height, stream_width, stream_height);
 
-        osdItem->rgnAttr.data.picData.pData = osdItem->data;
+        osdItem->rgnAttr.data.picData.pData = bitmap.data;
         osdItem->rgnAttrData = &osdItem->rgnAttr.data;
 
-        osdItem->width = item_width;
-        osdItem->height = item_height;
+        osdItem->width = bitmap.width;
+        osdItem->height = bitmap.height;
+        account(osdItem, bitmap.width, bitmap.height);
 
         IMP_OSD_SetRgnAttr(osdItem->imp_rgn, &osdItem->rgnAttr);
     }
     else
     {
-        osdItem->rgnAttrData->picData.pData = osdItem->data;
+        osdItem->rgnAttrData->picData.pData = bitmap.data;
         IMP_OSD_UpdateRgnAttrData(osdItem->imp_rgn, osdItem->rgnAttrData);
     }
+}
 
-    return;
+// initial text of an item, a bitmap drawn by the other stream is kept
+void OSD::set_text(OSDItem *osdItem, IMPOSDRgnAttr *irgnAttr, const char *text, int posX, int posY, int angle)
+{
+    if (osdItem->bitmap->data == nullptr)
+        font->render(*osdItem->bitmap, text, angle);
+    show(osdItem, irgnAttr, posX, posY);
 }
 
 unsigned long getSystemUptime()
@@ -358,77 +153,6 @@ void replace(std::string& str, const std::string& oldToken, const std::string& n
     }
 }
 
-void OSD::rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &height, int angle, bool del = true)
-{
-    double angleRad = angle * (M_PI / 180.0);
-
-    int originalCorners[4][2] = {
-        {0, 0},
-        {width, 0},
-        {0, height},
-        {width, height}};
-
-    int minX = INT_MAX;
-    int maxX = INT_MIN;
-    int minY = INT_MAX;
-    int maxY = INT_MIN;
-
-    for (auto &originalCorner : originalCorners)
-    {
-        int x = originalCorner[0];
-        int y = originalCorner[1];
-
-        int newX = static_cast<int>(x * cos(angleRad) - y * sin(angleRad));
-        int newY = static_cast<int>(x * sin(angleRad) + y * cos(angleRad));
-
-        if (newX < minX)
-            minX = newX;
-        if (newX > maxX)
-            maxX = newX;
-        if (newY < minY)
-            minY = newY;
-        if (newY > maxY)
-            maxY = newY;
-    }
-
-    int newWidth = maxX - minX + 1;
-    int newHeight = maxY - minY + 1;
-
-    int centerX = width / 2;
-    int centerY = height / 2;
-
-    int newCenterX = newWidth / 2;
-    int newCenterY = newHeight / 2;
-
-    auto *rotatedImage = new uint8_t[newWidth * newHeight * 4]();
-
-    for (int y = 0; y < newHeight; ++y)
-    {
-        for (int x = 0; x < newWidth; ++x)
-        {
-            int newX = x - newCenterX;
-            int newY = y - newCenterY;
-
-            int origX = static_cast<int>(newX * cos(angleRad) + newY * sin(angleRad)) + centerX;
-            int origY = static_cast<int>(-newX * sin(angleRad) + newY * cos(angleRad)) + centerY;
-
-            if (origX >= 0 && origX < width && origY >= 0 && origY < height)
-            {
-                for (int c = 0; c < 4; ++c)
-                {
-                    rotatedImage[(y * newWidth + x) * 4 + c] = inputImage[(origY * width + origX) * 4 + c];
-                }
-            }
-        }
-    }
-
-    if (del)
-        delete[] inputImage;
-    inputImage = rotatedImage;
-    width = newWidth;
-    height = newHeight;
-}
-
 uint16_t OSD::get_abs_pos(const uint16_t max, const uint16_t size, const int pos)
 {
     if (pos == 0)
@@ -495,6 +219,105 @@ unsigned char *loadBGRAImage(const char *filepath, size_t &length)
     return data;
 }
 
+std::atomic<int> OSD::pool_used{0};
+
+/* the regions of all groups are allocated from the OSD pool, BGRA with
+ * 4 bytes per pixel. keeps the total up to date when a region changes size.
+ */
+void OSD::account(OSDItem *osdItem, uint16_t width, uint16_t height)
+{
+    int bytes = width * height * 4;
+    int used = pool_used.fetch_add(bytes - osdItem->pool_bytes) + bytes - osdItem->pool_bytes;
+    osdItem->pool_bytes = bytes;
+
+    if (!bytes)
+        return;
+
+    int pool_size = cfg->general.osd_pool_size * 1024;
+    LOG_DEBUG("OSD region " << osdItem->imp_rgn << " of group " << osdGrp << " " << width << "x" << height
+                            << " uses " << bytes << " bytes, pool " << used << "/" << pool_size);
+    if (used > pool_size)
+    {
+        LOG_WARN("OSD regions need " << used << " bytes, more than osd_pool_size " << pool_size
+                                     << ". Increase it or set it to 0 to size it automatically.");
+    }
+}
+
+// bounding box of a width x height image rotated by angle degrees
+static void rotated_size(int angle, int &width, int &height)
+{
+    double rad = angle * M_PI / 180.0;
+    double c = std::fabs(std::cos(rad));
+    double s = std::fabs(std::sin(rad));
+    int w = std::ceil(width * c + height * s);
+    int h = std::ceil(width * s + height * c);
+    width = w;
+    height = h;
+}
+
+/* pool bytes the OSD of a stream will need. the texts are measured with
+ * wide sample values, a quarter is added for texts that grow.
+ * it runs before init, an auto font size is resolved the same way here.
+ */
+int OSD::poolEstimate(const _stream &stream)
+{
+    if (!stream.osd.enabled)
+        return 0;
+
+    _osd osd = stream.osd;
+    if (osd.font_size == OSD_AUTO_VALUE)
+        osd.font_size = autoFontSize(stream.width);
+
+    int bytes = 0;
+    auto add = [&bytes](int width, int height, int angle) {
+        rotated_size(angle, width, height);
+        bytes += width * height * 4;
+    };
+
+    std::shared_ptr<OSDFont> font = OSDFont::get(osd);
+    if (font)
+    {
+        uint16_t width, height;
+        char text[256];
+
+        if (osd.time_enabled)
+        {
+            time_t now = time(nullptr);
+            strftime(text, sizeof(text), osd.time_format, localtime(&now));
+            font->measure(text, width, height);
+            add(width, height, osd.time_rotation);
+        }
+
+        if (osd.user_text_enabled)
+        {
+            char hostname[64];
+            gethostname(hostname, sizeof(hostname));
+
+            std::string user_text = osd.user_text_format;
+            replace(user_text, "%hostname", hostname);
+            replace(user_text, "%ipaddress", "255.255.255.255");
+            replace(user_text, "%fps", "999");
+            replace(user_text, "%bps", "99999");
+            font->measure(user_text.c_str(), width, height);
+            add(width, height, osd.user_text_rotation);
+        }
+
+        if (osd.uptime_enabled)
+        {
+            snprintf(text, sizeof(text), osd.uptime_format, 9999UL, 23UL, 59UL);
+            font->measure(text, width, height);
+            add(width, height, osd.uptime_rotation);
+        }
+    }
+
+    bytes += bytes / 4;
+
+    if (osd.logo_enabled)
+        add(osd.logo_width, osd.logo_height, osd.logo_rotation);
+
+    return bytes;
+}
+
 OSD *OSD::createNew(
     _osd &osd,
     int osdGrp,
@@ -513,7 +336,7 @@ void OSD::init()
     LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_SetPoolSize(" << (cfg->general.osd_pool_size * 1024) << ")");
 
     // cfg = _cfg;
-    last_updated_second = -1;
+    last_update = 0;
 
     ret = IMP_Encoder_GetChnAttr(osdGrp, &channelAttributes);
     if (ret < 0)
@@ -540,12 +363,13 @@ void OSD::init()
         cfg->set<int>(getConfigPath("font_size"), fontSize, true);
     } 
 
-    if (libschrift_init() != 0)
+    font = OSDFont::get(osd);
+    if (!font)
     {
-        LOG_DEBUG("libschrift init failed.");
+        LOG_ERROR("OSD font " << osd.font_path << " can't be loaded, text is disabled.");
     }
 
-    if (osd.time_enabled)
+    if (font && osd.time_enabled)
     {
         /* OSD Time */
         if (osd.pos_time_x == OSD_AUTO_VALUE)
@@ -558,7 +382,6 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_time_y").c_str(), autoOffset, true);
         }
 
-        osdTime.data = nullptr;
         osdTime.imp_rgn = IMP_OSD_CreateRgn(nullptr);
         IMP_OSD_RegisterRgn(osdTime.imp_rgn, osdGrp, nullptr);
         osd.regions.time = osdTime.imp_rgn;
@@ -566,6 +389,7 @@ void OSD::init()
         memset(&osdTime.rgnAttr, 0, sizeof(IMPOSDRgnAttr));
         osdTime.rgnAttr.type = OSD_REG_PIC;
         osdTime.rgnAttr.fmt = PIX_FMT_BGRA;
+        item_bitmap(&osdTime, 't', osd.time_format, osd.time_rotation);
         set_text(&osdTime, &osdTime.rgnAttr, osd.time_format,
                  osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
         IMP_OSD_SetRgnAttr(osdTime.imp_rgn, &osdTime.rgnAttr);
@@ -579,7 +403,7 @@ void OSD::init()
         IMP_OSD_SetGrpRgnAttr(osdTime.imp_rgn, osdGrp, &grpRgnAttr);
     }
 
-    if (osd.user_text_enabled)
+    if (font && osd.user_text_enabled)
     {
         getIp(ip);
         gethostname(hostname, 64);
@@ -596,7 +420,6 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_user_text_y").c_str(), autoOffset, true);
         }
 
-        osdUser.data = nullptr;
         osdUser.imp_rgn = IMP_OSD_CreateRgn(nullptr);
         IMP_OSD_RegisterRgn(osdUser.imp_rgn, osdGrp, nullptr);
         osd.regions.user = osdUser.imp_rgn;
@@ -604,6 +427,7 @@ void OSD::init()
         memset(&osdUser.rgnAttr, 0, sizeof(IMPOSDRgnAttr));
         osdUser.rgnAttr.type = OSD_REG_PIC;
         osdUser.rgnAttr.fmt = PIX_FMT_BGRA;
+        item_bitmap(&osdUser, 'u', osd.user_text_format, osd.user_text_rotation);
         set_text(&osdUser, &osdUser.rgnAttr, osd.user_text_format,
                  osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
         IMP_OSD_SetRgnAttr(osdUser.imp_rgn, &osdUser.rgnAttr);
@@ -617,7 +441,7 @@ void OSD::init()
         IMP_OSD_SetGrpRgnAttr(osdUser.imp_rgn, osdGrp, &grpRgnAttr);
     }
 
-    if (osd.uptime_enabled)
+    if (font && osd.uptime_enabled)
     {
         /* OSD Uptime */
         if (osd.pos_uptime_x == OSD_AUTO_VALUE)
@@ -631,7 +455,6 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_uptime_y").c_str(), autoOffset, true);
         }
 
-        osdUptm.data = nullptr;
         osdUptm.imp_rgn = IMP_OSD_CreateRgn(nullptr);
         IMP_OSD_RegisterRgn(osdUptm.imp_rgn, osdGrp, nullptr);
         osd.regions.uptime = osdUptm.imp_rgn;
@@ -639,6 +462,7 @@ void OSD::init()
         memset(&osdUptm.rgnAttr, 0, sizeof(IMPOSDRgnAttr));
         osdUptm.rgnAttr.type = OSD_REG_PIC;
         osdUptm.rgnAttr.fmt = PIX_FMT_BGRA;
+        item_bitmap(&osdUptm, 'p', osd.uptime_format, osd.uptime_rotation);
         set_text(&osdUptm, &osdUptm.rgnAttr, osd.uptime_format,
                  osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
         IMP_OSD_SetRgnAttr(osdUptm.imp_rgn, &osdUptm.rgnAttr);
@@ -681,24 +505,31 @@ void OSD::init()
         {
             osdLogo.rgnAttr.type = OSD_REG_PIC;
             osdLogo.rgnAttr.fmt = PIX_FMT_BGRA;
-            osdLogo.rgnAttr.data.picData.pData = imageData;
+            osdLogo.data = imageData;
+            osdLogo.size = imageSize;
 
             // Logo rotation
             uint16_t logo_width = osd.logo_width;
             uint16_t logo_height = osd.logo_height;
             if (osd.logo_rotation)
             {
-                uint8_t *imageData = static_cast<uint8_t *>(osdLogo.rgnAttr.data.picData.pData);
-                rotateBGRAImage(imageData, logo_width,
-                                logo_height, osd.logo_rotation, false);
-                osdLogo.rgnAttr.data.picData.pData = imageData;
+                uint8_t *rotated = nullptr;
+                int rotatedSize = 0;
+                OSDFont::rotateBGRAImage(osdLogo.data, logo_width,
+                                logo_height, osd.logo_rotation, rotated, rotatedSize);
+                free(osdLogo.data);
+                osdLogo.data = rotated;
+                osdLogo.size = rotatedSize;
             }
+            osdLogo.rgnAttr.data.picData.pData = osdLogo.data;
 
             set_pos(&osdLogo.rgnAttr, osd.pos_logo_x,
                     osd.pos_logo_y, logo_width, logo_height, stream_width, stream_height);
+            account(&osdLogo, logo_width, logo_height);
         }
         else
         {
+            free(imageData);
 
             LOG_ERROR("Invalid OSD logo dimensions. Imagesize=" << imageSize << ", " << osd.logo_width
                                                                 << "*" << osd.logo_height << "*4=" << (osd.logo_width * osd.logo_height * 4));
@@ -714,8 +545,14 @@ void OSD::init()
         IMP_OSD_SetGrpRgnAttr(osdLogo.imp_rgn, osdGrp, &grpRgnAttr);
     }
 
-    if(osd.start_delay)
-        startup_delay = (int)(osd.start_delay*1000)/THREAD_SLEEP;
+    clock_gettime(CLOCK_REALTIME, &start_at);
+    start_at.tv_sec += osd.start_delay / 1000;
+    start_at.tv_nsec += (osd.start_delay % 1000) * 1000000L;
+    if (start_at.tv_nsec >= 1000000000L)
+    {
+        start_at.tv_sec++;
+        start_at.tv_nsec -= 1000000000L;
+    }
 
     //start();
 }
@@ -771,117 +608,336 @@ int OSD::exit()
     IMP_OSD_DestroyRgn(osdUptm.imp_rgn);
     IMP_OSD_DestroyRgn(osdLogo.imp_rgn);
 
+    for (int i = 0; i < OSD_MAX_REGIONS; i++)
+    {
+        if (regionDefs[i].name[0])
+            releaseRegion(i);
+    }
+
     ret = IMP_OSD_DestroyGroup(osdGrp);
     LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_DestroyGroup(" << osdGrp << ")");
 
-    // cleanup osd image data
-    free(osdTime.data);
-    free(osdUser.data);
-    free(osdUptm.data);
+    // cleanup osd image data, text bitmaps belong to the font
     free(osdLogo.data);
 
-    sft_freefont(sft->font);
+    for (OSDItem *item : {&osdTime, &osdUser, &osdUptm, &osdLogo})
+        account(item, 0, 0);
+
     return 0;
 }
 
+// render all items of the stream, called by the OSD thread right after a second begins
 void OSD::updateDisplayEverySecond()
 {
-    gettimeofday(&tm, NULL);
-
     current = time(nullptr);
+    if (current == last_update)
+        return;
+    last_update = current;
+
     ltime = localtime(&current);
 
-    // Check if we have moved to a new second
-    if (ltime->tm_sec != last_updated_second)
+    // the live osd config may be changed while we render, use the snapshot
+    CFGSnapshotRef snap = cfg->snapshot();
+    const _osd &conf = (encChn == 0) ? snap->stream0.osd : snap->stream1.osd;
+
+    // Format and update system time
+    // a text shared with the other stream is formatted and drawn once per second
+    if (conf.time_enabled && osdTime.bitmap)
     {
-        flag |= 7;
-        // Update the last second tracker
-        last_updated_second = ltime->tm_sec; 
+        OSDBitmap &bitmap = item_bitmap(&osdTime, 't', conf.time_format, conf.time_rotation);
+        if (bitmap.stamp != current)
+        {
+            strftime(timeFormatted, sizeof(timeFormatted), conf.time_format, ltime);
+            font->render(bitmap, timeFormatted, conf.time_rotation);
+            bitmap.stamp = current;
+        }
+        show(&osdTime, nullptr, conf.pos_time_x, conf.pos_time_y);
     }
-    else
+
+    // Format and update user text
+    // hostname and ip are fixed, the text only changes with %fps and %bps
+    if (conf.user_text_enabled && osdUser.bitmap)
     {
-        // The flag ensures that only 1 OSD object is updated
-        // on calling OSD::updateDisplayEverySecond()
-        // this should relieve the system
-        if (flag != 0)
+        OSDBitmap &bitmap = item_bitmap(&osdUser, 'u', conf.user_text_format, conf.user_text_rotation);
+        bool has_fps = strstr(conf.user_text_format, "%fps") != nullptr;
+        bool has_bps = strstr(conf.user_text_format, "%bps") != nullptr;
+        const _stream_stats &stats = global_video[encChn]->stats;
+
+        if (!bitmap.stamp || (has_fps && (int)stats.fps != shown_fps) || (has_bps && (int)stats.bps != shown_bps))
         {
-            
-            // Format and update system time
-            if ((flag & 1) && osd.time_enabled)
+            std::string user_text = conf.user_text_format;
+
+            if (strstr(conf.user_text_format, "%hostname") != nullptr)
             {
-                strftime(timeFormatted, sizeof(timeFormatted), osd.time_format, ltime);
+                replace(user_text, "%hostname", hostname);
+            }
 
-                set_text(&osdTime, nullptr, timeFormatted,
-                         osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
+            if (strstr(conf.user_text_format, "%ipaddress") != nullptr)
+            {
+                replace(user_text, "%ipaddress", ip);
+            }
 
-                flag ^= 1;
-                return;
+            if (has_fps)
+            {
+                shown_fps = stats.fps;
+                snprintf(fps, 4, "%3d", shown_fps);
+                replace(user_text, "%fps", fps);
             }
 
-            // Format and update user text
-            if ((flag & 2) && osd.user_text_enabled)
+            if (has_bps)
             {
-                std::string user_text = osd.user_text_format;
+                shown_bps = stats.bps;
+                snprintf(bps, 8, "%5d", shown_bps);
+                replace(user_text, "%bps", bps);
+            }
 
-                if (strstr(osd.user_text_format, "%hostname") != nullptr)
-                {
-                    replace(user_text, "%hostname", hostname);
-                }
+            font->render(bitmap, user_text.c_str(), conf.user_text_rotation);
+            bitmap.stamp = current;
+        }
+        show(&osdUser, nullptr, conf.pos_user_text_x, conf.pos_user_text_y);
+    }
 
-                if (strstr(osd.user_text_format, "%ipaddress") != nullptr)
-                {
-                    replace(user_text, "%ipaddress", ip);
-                }
+    // Format and update uptime, it shows minutes so it changes once a minute
+    if (conf.uptime_enabled && osdUptm.bitmap)
+    {
+        OSDBitmap &bitmap = item_bitmap(&osdUptm, 'p', conf.uptime_format, conf.uptime_rotation);
+        unsigned long currentUptime = getSystemUptime();
+        // + 1, a stamp of 0 marks a bitmap that was never formatted
+        time_t minute = currentUptime / 60 + 1;
+        if (bitmap.stamp != minute)
+        {
+            unsigned long days = currentUptime / 86400;
+            unsigned long hours = (currentUptime % 86400) / 3600;
+            unsigned long minutes = (currentUptime % 3600) / 60;
+            //unsigned long seconds = currentUptime % 60;
+
+            snprintf(uptimeFormatted, sizeof(uptimeFormatted), conf.uptime_format, days, hours, minutes);
+            font->render(bitmap, uptimeFormatted, conf.uptime_rotation);
+            bitmap.stamp = minute;
+        }
+        show(&osdUptm, nullptr, conf.pos_uptime_x, conf.pos_uptime_y);
+    }
+}
 
-                if (strstr(osd.user_text_format, "%fps") != nullptr)
-                {
-                    char fps[4];
-                    snprintf(fps, 4, "%3d", osd.stats.fps);
-                    replace(user_text, "%fps", fps);
-                }
+// bitmap key of a text region in the font
+static std::string region_key(int encChn, const char *name)
+{
+    return "r" + std::to_string(encChn) + ":" + name;
+}
 
-                if (strstr(osd.user_text_format, "%bps") != nullptr)
-                {
-                    char bps[8];
-                    snprintf(bps, 8, "%5d", osd.stats.bps);
-                    replace(user_text, "%bps", bps);
-                }
+/* apply the regions of the API that changed since the last call.
+ * a region is only rendered again when its version has changed.
+ */
+void OSD::updateRegions()
+{
+    unsigned int changes = OSDRegions::changes();
+    if (changes == region_changes)
+        return;
+    region_changes = changes;
 
-                set_text(&osdUser, nullptr, user_text.c_str(),
-                         osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
+    OSDRegion defs[OSD_MAX_REGIONS];
+    int count = OSDRegions::list(encChn, defs);
 
-                user_text.clear();
+    // removed regions first, their slots and pool memory are free afterwards
+    for (int i = 0; i < OSD_MAX_REGIONS; i++)
+    {
+        if (!regionDefs[i].name[0])
+            continue;
 
-                flag ^= 2;
-                return;
-            }
+        bool found = false;
+        for (int j = 0; j < count && !found; j++)
+            found = strcmp(defs[j].name, regionDefs[i].name) == 0;
+
+        if (!found)
+            releaseRegion(i);
+    }
+
+    for (int j = 0; j < count; j++)
+    {
+        int slot = -1;
+        for (int i = 0; i < OSD_MAX_REGIONS && slot < 0; i++)
+        {
+            if (strcmp(defs[j].name, regionDefs[i].name) == 0)
+                slot = i;
+        }
+
+        if (slot >= 0 && regionDefs[slot].version == defs[j].version)
+            continue;
 
-            // Format and update uptime
-            if ((flag & 4) && osd.uptime_enabled)
+        if (slot < 0)
+        {
+            for (int i = 0; i < OSD_MAX_REGIONS && slot < 0; i++)
             {
-                unsigned long currentUptime = getSystemUptime();
-                unsigned long days = currentUptime / 86400;
-                unsigned long hours = (currentUptime % 86400) / 3600;
-                unsigned long minutes = (currentUptime % 3600) / 60;
-                //unsigned long seconds = currentUptime % 60;
+                if (!regionDefs[i].name[0])
+                    slot = i;
+            }
+        }
+
+        if (slot >= 0)
+            applyRegion(slot, defs[j]);
+    }
+}
+
+/* render a region and show it. it's admitted only if its size fits into
+ * the pool, otherwise the old content stays and the state tells why.
+ */
+void OSD::applyRegion(int slot, const OSDRegion &region)
+{
+    OSDItem *item = &regionItems[slot];
+    OSDRegion &shown = regionDefs[slot];
+    std::string key = region_key(encChn, region.name);
+
+    int width;
+    int height;
+    uint8_t *image = nullptr;
+    int imageSize = 0;
 
-                snprintf(uptimeFormatted, sizeof(uptimeFormatted), osd.uptime_format, days, hours, minutes);
+    if (region.text[0])
+    {
+        if (!font)
+        {
+            OSDRegions::report(region.name, region.version, OSD_REGION_INVALID);
+            return;
+        }
 
-                set_text(&osdUptm, nullptr, uptimeFormatted,
-                         osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
+        uint16_t w, h;
+        font->measure(region.text, w, h);
+        width = w;
+        height = h;
+        rotated_size(region.rotation, width, height);
+    }
+    else
+    {
+        size_t length = 0;
+        image = loadBGRAImage(region.image, length);
+        if (!image || (int)length != region.width * region.height * 4)
+        {
+            free(image);
+            LOG_ERROR("Invalid OSD region image " << region.image);
+            OSDRegions::report(region.name, region.version, OSD_REGION_INVALID);
+            return;
+        }
 
-                flag ^= 4;
-                return;
-            }          
+        uint16_t w = region.width;
+        uint16_t h = region.height;
+        imageSize = length;
+        if (region.rotation)
+        {
+            // rotateBGRAImage allocates the target when its size is too small
+            uint8_t *rotated = nullptr;
+            int rotatedSize = 0;
+            OSDFont::rotateBGRAImage(image, w, h, region.rotation, rotated, rotatedSize);
+            free(image);
+            image = rotated;
+            imageSize = rotatedSize;
         }
+        width = w;
+        height = h;
+    }
+
+    int needed = pool_used - item->pool_bytes + width * height * 4;
+    if (needed > cfg->general.osd_pool_size * 1024)
+    {
+        free(image);
+        LOG_WARN("OSD region " << region.name << " needs " << width * height * 4 << " bytes, the pool is full");
+        OSDRegions::report(region.name, region.version, OSD_REGION_NO_POOL);
+        return;
+    }
+
+    bool created = shown.name[0] != 0;
+    if (!created)
+    {
+        item->imp_rgn = IMP_OSD_CreateRgn(nullptr);
+        IMP_OSD_RegisterRgn(item->imp_rgn, osdGrp, nullptr);
+
+        memset(&item->rgnAttr, 0, sizeof(IMPOSDRgnAttr));
+        item->rgnAttr.type = OSD_REG_PIC;
+        item->rgnAttr.fmt = PIX_FMT_BGRA;
     }
+
+    if (region.text[0])
+    {
+        free(regionImages[slot].data);
+        regionImages[slot] = OSDBitmap{};
+
+        item->bitmap = &font->bitmap(key);
+        font->render(*item->bitmap, region.text, region.rotation);
+    }
+    else
+    {
+        if (shown.text[0] && font)
+            font->release(key);
+
+        OSDBitmap &bitmap = regionImages[slot];
+        free(bitmap.data);
+        bitmap.data = image;
+        bitmap.size = imageSize;
+        bitmap.width = width;
+        bitmap.height = height;
+        bitmap.serial++;
+        item->bitmap = &bitmap;
+    }
+
+    // a new position is only set together with a new size, force it
+    if (!created || region.x != shown.x || region.y != shown.y)
+        item->width = 0;
+    show(item, &item->rgnAttr, region.x, region.y);
+
+    IMPOSDGrpRgnAttr grpRgnAttr;
+    memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
+    grpRgnAttr.show = 1;
+    grpRgnAttr.layer = 5;
+    grpRgnAttr.gAlphaEn = 1;
+    grpRgnAttr.fgAlhpa = region.transparency;
+    IMP_OSD_SetGrpRgnAttr(item->imp_rgn, osdGrp, &grpRgnAttr);
+
+    shown = region;
+    OSDRegions::report(region.name, region.version, OSD_REGION_SHOWN);
 }
 
+void OSD::releaseRegion(int slot)
+{
+    OSDItem *item = &regionItems[slot];
+    OSDRegion &shown = regionDefs[slot];
+
+    int ret = IMP_OSD_ShowRgn(item->imp_rgn, osdGrp, 0);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(" << shown.name << ", " << osdGrp << ", 0)");
+
+    ret = IMP_OSD_UnRegisterRgn(item->imp_rgn, osdGrp);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(" << shown.name << ", " << osdGrp << ")");
+
+    IMP_OSD_DestroyRgn(item->imp_rgn);
+    account(item, 0, 0);
+
+    if (shown.text[0] && font)
+        font->release(region_key(encChn, shown.name));
+
+    free(regionImages[slot].data);
+    regionImages[slot] = OSDBitmap{};
+    *item = OSDItem{};
+    shown = OSDRegion{};
+}
+
+static bool timespec_before(const struct timespec &a, const struct timespec &b)
+{
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+/* the thread sleeps until the next second begins and updates all streams
+ * at once, so the time is shown without delay. it wakes earlier to start
+ * an OSD after its start_delay and when a region of the API has changed.
+ */
 void *OSD::thread_entry(void *arg) {
     LOG_DEBUG("start osd update thread.");
 
     global_osd_thread_signal = true;
     while (global_osd_thread_signal) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        struct timespec wake = {now.tv_sec + 1, 0};
+        unsigned int changes = OSDRegions::changes();
+
         for (auto v : global_video)
         {
             if (v != nullptr)
@@ -890,26 +946,27 @@ void *OSD::thread_entry(void *arg) {
                 {
                     if ((v->imp_encoder->osd != nullptr))
                     {
-                        if (v->imp_encoder->osd->is_started)
+                        OSD *osd = v->imp_encoder->osd;
+                        if (osd->is_started)
+                        {
+                            osd->updateDisplayEverySecond();
+                            osd->updateRegions();
+                        }
+                        else if (timespec_before(now, osd->start_at))
                         {
-                            v->imp_encoder->osd->updateDisplayEverySecond();
+                            if (timespec_before(osd->start_at, wake))
+                                wake = osd->start_at;
                         }
                         else
                         {
-                            if (v->imp_encoder->osd->startup_delay)
-                            {
-                                v->imp_encoder->osd->startup_delay--;
-                            }
-                            else
-                            {
-                                v->imp_encoder->osd->start();
-                            }
+                            osd->start();
                         }
                     }
                 }
             }
         }
-        usleep(THREAD_SLEEP);
+
+        OSDRegions::wait(wake, changes);
     }
 
     LOG_DEBUG("exit osd update thread.");
@@ -2,6 +2,7 @@
 #define OSD_hpp
 
 //#include <map>
+#include <atomic>
 #include <memory>
 #include "Config.hpp"
 #include <imp/imp_osd.h>
@@ -10,7 +11,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/sysinfo.h>
-#include "schrift.h"
+#include "OSDFont.hpp"
+#include "OSDRegions.hpp"
 
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
 #define IMPEncoderCHNAttr IMPEncoderChnAttr
@@ -25,16 +27,16 @@ struct OSDItem
     uint16_t height;
     IMPOSDRgnAttr rgnAttr;
     IMPOSDRgnAttrData *rgnAttrData;
-};
-
-struct Glyph {
-    int width;
-    int height;
-    std::vector<uint8_t> bitmap;
-    int advance;
-    int xmin;
-    int ymin;
-    SFT_Glyph glyph;
+    // allocated bytes of data (logo)
+    int size;
+    // shared text bitmap, serial of the version the region shows
+    OSDBitmap *bitmap;
+    const OSDFont *font;
+    const char *format;
+    int angle;
+    unsigned int serial;
+    // OSD pool memory of the region
+    int pool_bytes;
 };
 
 class OSD
@@ -50,31 +52,25 @@ public:
     int start();
 
     void updateDisplayEverySecond();
+    void updateRegions();
     static void *thread_entry(void *arg);
 
-    void rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &height, int angle, bool del);
     static void set_pos(IMPOSDRgnAttr *rgnAttr, int x, int y, uint16_t width, uint16_t height, const uint16_t max_width, const uint16_t max_height);
     static uint16_t get_abs_pos(const uint16_t max,const uint16_t size,const int pos);
-    int startup_delay{0};
+    static int poolEstimate(const _stream &stream);
+    // realtime clock when start_delay is over
+    struct timespec start_at{};
     bool is_started = false;
     
 private:
 
-    // libschrift
-    //std::vector<uint8_t> fontData;
-    std::unordered_map<char, Glyph> glyphs;
-    SFT *sft;
-    int load_font();
-    int libschrift_init();
-    int renderGlyph(const char* characters);
-    void drawOutline(uint8_t* image, const Glyph& g, int x, int y, int outlineSize, int WIDTH, int HEIGHT);
-    int calculateTextSize(const char* text, uint16_t& width, uint16_t& height, int outlineSize);
-    int drawText(uint8_t* image, const char* text, int WIDTH, int HEIGHT, int outlineSize);
-    uint8_t BGRA_STROKE[4];
-    uint8_t BGRA_TEXT[4];
+    std::shared_ptr<OSDFont> font;
+    // bytes of all regions in the OSD pool
+    static std::atomic<int> pool_used;
 
     _osd &osd;
-    int last_updated_second;
+    // second of the last update
+    time_t last_update;
     
 
     OSDItem osdTime{};
@@ -82,6 +78,17 @@ private:
     OSDItem osdUptm{};
     OSDItem osdLogo{};
 
+    // regions of the API, the definition they show and the image bitmaps
+    OSDItem regionItems[OSD_MAX_REGIONS]{};
+    OSDRegion regionDefs[OSD_MAX_REGIONS]{};
+    OSDBitmap regionImages[OSD_MAX_REGIONS]{};
+    unsigned int region_changes{0};
+
+    OSDBitmap &item_bitmap(OSDItem *osdItem, char kind, const char *format, int angle);
+    void show(OSDItem *osdItem, IMPOSDRgnAttr *rgnAttr, int posX, int posY);
+    void account(OSDItem *osdItem, uint16_t width, uint16_t height);
+    void applyRegion(int slot, const OSDRegion &region);
+    void releaseRegion(int slot);
     void set_text(OSDItem *osdItem, IMPOSDRgnAttr *rgnAttr, const char *text, int posX, int posY, int angle);
     std::string getConfigPath(const char *itemName);
 
@@ -100,13 +107,14 @@ private:
 
     time_t current;
     struct tm *ltime;
-    struct timeval tm;
 
     char timeFormatted[32];
     char uptimeFormatted[32];
     char fps[4];
     char bps[8];
-    uint8_t flag{0};
+    // stream stats of the user text
+    int shown_fps{-1};
+    int shown_bps{-1};
 };
 
 #endif
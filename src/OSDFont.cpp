@@ -0,0 +1,625 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include "OSDFont.hpp"
+#include "Logger.hpp"
+
+// fonts in use, an entry expires with the last OSD that uses it
+static std::map<std::string, std::weak_ptr<OSDFont>> fonts;
+static std::mutex fonts_mutex;
+
+std::shared_ptr<OSDFont> OSDFont::get(const _osd &osd)
+{
+    std::string key = std::string(osd.font_path) + ":" + std::to_string(osd.font_size) + ":" +
+                      std::to_string(osd.font_xscale) + ":" + std::to_string(osd.font_yscale) + ":" +
+                      std::to_string(osd.font_yoffset) + ":" + std::to_string(osd.font_stroke) + ":" +
+                      std::to_string(osd.font_color) + ":" + std::to_string(osd.font_stroke_color);
+
+    std::lock_guard<std::mutex> lock(fonts_mutex);
+
+    std::shared_ptr<OSDFont> font = fonts[key].lock();
+    if (font)
+    {
+        LOG_DEBUG("OSD font " << key << " shared");
+        return font;
+    }
+
+    font.reset(new OSDFont());
+    if (font->load(osd) != 0)
+    {
+        fonts.erase(key);
+        return nullptr;
+    }
+
+    // drop entries of fonts that are gone
+    for (auto it = fonts.begin(); it != fonts.end();)
+        it = it->second.expired() ? fonts.erase(it) : std::next(it);
+
+    fonts[key] = font;
+    return font;
+}
+
+/* decode the next UTF-8 code point and advance p.
+ * invalid or truncated sequences give U+FFFD for their first byte.
+ */
+static uint32_t next_codepoint(const char *&p)
+{
+    const unsigned char *s = (const unsigned char *)p;
+    uint32_t cp;
+    int len;
+
+    if (s[0] < 0x80)
+    {
+        p++;
+        return s[0];
+    }
+    else if ((s[0] & 0xE0) == 0xC0)
+    {
+        cp = s[0] & 0x1F;
+        len = 2;
+    }
+    else if ((s[0] & 0xF0) == 0xE0)
+    {
+        cp = s[0] & 0x0F;
+        len = 3;
+    }
+    else if ((s[0] & 0xF8) == 0xF0)
+    {
+        cp = s[0] & 0x07;
+        len = 4;
+    }
+    else
+    {
+        p++;
+        return 0xFFFD;
+    }
+
+    for (int i = 1; i < len; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            p++;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    p += len;
+    return cp;
+}
+
+OSDFont::~OSDFont()
+{
+    for (auto &[key, bitmap] : bitmaps)
+        free(bitmap.data);
+
+    if (sft.font)
+        sft_freefont(sft.font);
+}
+
+int OSDFont::load(const _osd &osd)
+{
+    LOG_DEBUG("OSDFont::load(" << osd.font_path << ", " << osd.font_size << ")");
+
+    BGRA_TEXT[2] = (osd.font_color >> 16) & 0xFF;
+    BGRA_TEXT[1] = (osd.font_color >> 8) & 0xFF;
+    BGRA_TEXT[0] = (osd.font_color >> 0) & 0xFF;
+    BGRA_TEXT[3] = 0;
+
+    BGRA_STROKE[2] = (osd.font_stroke_color >> 16) & 0xFF;
+    BGRA_STROKE[1] = (osd.font_stroke_color >> 8) & 0xFF;
+    BGRA_STROKE[0] = (osd.font_stroke_color >> 0) & 0xFF;
+    BGRA_STROKE[3] = 255;
+
+    // the font file is mapped, it stays open to render other glyphs on demand
+    sft.flags = SFT_DOWNWARD_Y;
+    sft.xScale = osd.font_size * osd.font_xscale / 100;
+    sft.yScale = osd.font_size * osd.font_yscale / 100;
+    sft.yOffset = osd.font_yoffset;
+    sft.font = sft_loadfile(osd.font_path);
+    if (!sft.font)
+    {
+        LOG_DEBUG("Unable to load font file.");
+        return -1;
+    }
+
+    yScale = sft.yScale;
+    outline = osd.font_stroke;
+
+    // outline of a pixel, a disk with the stroke as radius
+    for (int j = -outline; j <= outline; ++j)
+    {
+        for (int i = -outline; i <= outline; ++i)
+        {
+            if (i * i + j * j <= outline * outline) // Use circular distance
+                disk.emplace_back(i, j);
+        }
+    }
+
+    // printable ASCII is rendered now, all other code points when they are used
+    for (uint32_t cp = 0x20; cp < 0x7F; cp++)
+        renderGlyph(cp, ascii[cp]);
+    ascii_atlas_size = atlas.size();
+
+    return 0;
+}
+
+OSDBitmap &OSDFont::bitmap(const std::string &key)
+{
+    return bitmaps[key];
+}
+
+void OSDFont::release(const std::string &key)
+{
+    auto it = bitmaps.find(key);
+    if (it == bitmaps.end())
+        return;
+
+    free(it->second.data);
+    bitmaps.erase(it);
+}
+
+// glyph of a code point, nullptr if the font can't render it
+const Glyph *OSDFont::glyph(uint32_t cp) const
+{
+    if (cp < ascii.size())
+        return ascii[cp].valid ? &ascii[cp] : nullptr;
+
+    auto it = extra.find(cp);
+    return (it != extra.end() && it->second.valid) ? &it->second : nullptr;
+}
+
+/* render the glyphs of the text that are not in the atlas yet.
+ * if they don't fit in the cache, all non ASCII glyphs are dropped first
+ * and the ones of the text rendered again, never while the text is being
+ * prepared. a text with more glyphs than the cache keeps them all until
+ * the next clear.
+ */
+void OSDFont::prepare(const char *text)
+{
+    std::vector<uint32_t> missing;
+    auto collect = [&]() {
+        missing.clear();
+        for (const char *p = text; *p;)
+        {
+            uint32_t cp = next_codepoint(p);
+            if (cp < ascii.size() || extra.count(cp) || std::find(missing.begin(), missing.end(), cp) != missing.end())
+                continue;
+            missing.push_back(cp);
+        }
+    };
+
+    collect();
+    if (missing.empty())
+        return;
+
+    if (extra.size() + missing.size() > OSD_GLYPH_CACHE_SIZE)
+    {
+        extra.clear();
+        atlas.resize(ascii_atlas_size);
+        collect();
+    }
+
+    for (uint32_t cp : missing)
+        renderGlyph(cp, extra[cp]);
+}
+
+/* render a code point and add it to the atlas.
+ * a cell is the glyph grown by the outline on each side, the outline is the
+ * coverage stamped with a disk of radius outline, the text is on top.
+ * drawing text is a plain copy of the cells after that.
+ */
+void OSDFont::renderGlyph(uint32_t cp, Glyph &g)
+{
+    SFT_LMetrics lmetrics;
+    SFT_GMetrics gmetrics;
+    SFT_Glyph glyph;
+    SFT_Image imageBuffer;
+
+    g.valid = false;
+
+    if (sft_lmetrics(&sft, &lmetrics) != 0 || sft_lookup(&sft, cp, &glyph) != 0 ||
+        sft_gmetrics(&sft, glyph, &gmetrics) != 0)
+    {
+        return;
+    }
+
+    imageBuffer.width = gmetrics.minWidth;
+    imageBuffer.height = gmetrics.minHeight;
+    g.coverage.assign(imageBuffer.width * imageBuffer.height, 0);
+    imageBuffer.pixels = g.coverage.data();
+
+    if (sft_render(&sft, glyph, imageBuffer) != 0)
+        return;
+
+    g.width = imageBuffer.width;
+    g.height = imageBuffer.height;
+    g.advance = gmetrics.advanceWidth;
+    g.xmin = gmetrics.leftSideBearing;
+    g.ymin = gmetrics.yOffset;
+    g.glyph = glyph;
+
+    g.cell_width = g.width + 2 * outline;
+    g.cell_height = g.height + 2 * outline;
+    g.offset = atlas.size();
+    atlas.resize(atlas.size() + g.cell_width * g.cell_height * 4, 0);
+
+    uint8_t *cell = atlas.data() + g.offset;
+
+    for (int h = 0; h < g.height; ++h)
+    {
+        for (int w = 0; w < g.width; ++w)
+        {
+            if (g.coverage[h * g.width + w] == 0)
+                continue;
+
+            for (auto &[i, j] : disk)
+            {
+                memcpy(cell + ((h + outline + j) * g.cell_width + w + outline + i) * 4,
+                       BGRA_STROKE, 4);
+            }
+        }
+    }
+
+    for (int h = 0; h < g.height; ++h)
+    {
+        for (int w = 0; w < g.width; ++w)
+        {
+            uint8_t alpha = g.coverage[h * g.width + w];
+            if (alpha > 0)
+            {
+                uint8_t *px = cell + ((h + outline) * g.cell_width + w + outline) * 4;
+                px[0] = BGRA_TEXT[0];
+                px[1] = BGRA_TEXT[1];
+                px[2] = BGRA_TEXT[2];
+                px[3] = alpha;
+            }
+        }
+    }
+
+    g.valid = true;
+}
+
+// copy the drawn pixels of a glyph cell, x and y are the cell origin
+void OSDFont::blitGlyph(uint8_t *image, const Glyph &g, int x, int y, int WIDTH, int HEIGHT, int clipX0, int clipX1)
+{
+    int x0 = std::max(std::max(0, clipX0) - x, 0);
+    int x1 = std::min(g.cell_width, std::min(WIDTH, clipX1) - x);
+    int y0 = std::max(0, -y);
+    int y1 = std::min(g.cell_height, HEIGHT - y);
+
+    for (int j = y0; j < y1; ++j)
+    {
+        const uint8_t *src = atlas.data() + g.offset + (j * g.cell_width + x0) * 4;
+        uint8_t *dst = image + ((y + j) * WIDTH + x + x0) * 4;
+        for (int i = x0; i < x1; ++i, src += 4, dst += 4)
+        {
+            if (src[3] > 0)
+            { // Check alpha value
+                memcpy(dst, src, 4);
+            }
+        }
+    }
+}
+
+/* draw the text, only pixels in the columns clipX0 to clipX1 are written.
+ * the glyphs are drawn in order, so a clipped draw gives the same pixels
+ * as a full one.
+ */
+int OSDFont::drawText(uint8_t *image, const char *text, int WIDTH, int HEIGHT, int clipX0, int clipX1)
+{
+    int penX = 1;
+    int penY = 1;
+
+    // Draw text and outline
+    while (*text)
+    {
+        if (const Glyph *g = glyph(next_codepoint(text)))
+        {
+            // the cell starts outline before the glyph
+            int x = penX + g->xmin;
+            int y = penY + (yScale + g->ymin) - outline;
+
+            if (x < clipX1 && x + g->cell_width > clipX0)
+                blitGlyph(image, *g, x, y, WIDTH, HEIGHT, clipX0, clipX1);
+
+            penX += g->advance + (outline * 2);
+        }
+    }
+
+    return 0;
+}
+
+/* redraw only the glyphs that differ from the last text of the bitmap.
+ * works if the layout is unchanged, same number of characters and the same
+ * advance at every position, like digits of a time or uptime. returns false
+ * if the bitmap needs a full redraw.
+ */
+bool OSDFont::updateText(OSDBitmap &bitmap, const char *text)
+{
+    auto advance = [](const Glyph *g) { return g ? g->advance : -1; };
+
+    const char *a = bitmap.text;
+    const char *b = text;
+    if (!*a || strlen(text) >= sizeof(bitmap.text))
+        return false;
+
+    while (*a && *b)
+    {
+        uint32_t prev = next_codepoint(a);
+        uint32_t next = next_codepoint(b);
+        if (prev != next && advance(glyph(prev)) != advance(glyph(next)))
+            return false;
+    }
+    if (*a || *b)
+        return false;
+
+    // collect the changed columns, overlapping cells are redrawn together
+    int penX = 1;
+    int dirtyX0 = 0;
+    int dirtyX1 = 0;
+    auto flush = [&]() {
+        int x0 = std::max(dirtyX0, 0);
+        int x1 = std::min(dirtyX1, (int)bitmap.width);
+        if (x0 >= x1)
+            return;
+        for (int y = 0; y < bitmap.height; y++)
+            memset(bitmap.data + (y * bitmap.width + x0) * 4, 0, (x1 - x0) * 4);
+        drawText(bitmap.data, text, bitmap.width, bitmap.height, x0, x1);
+    };
+
+    a = bitmap.text;
+    b = text;
+    while (*b)
+    {
+        uint32_t prev = next_codepoint(a);
+        uint32_t next = next_codepoint(b);
+        const Glyph *g = glyph(next);
+        if (prev != next)
+        {
+            for (const Glyph *c : {glyph(prev), g})
+            {
+                if (!c)
+                    continue;
+
+                int x0 = penX + c->xmin;
+                int x1 = x0 + c->cell_width;
+                if (dirtyX0 < dirtyX1 && x0 <= dirtyX1)
+                {
+                    dirtyX0 = std::min(dirtyX0, x0);
+                    dirtyX1 = std::max(dirtyX1, x1);
+                }
+                else
+                {
+                    flush();
+                    dirtyX0 = x0;
+                    dirtyX1 = x1;
+                }
+            }
+        }
+        if (g)
+            penX += g->advance + (outline * 2);
+    }
+    flush();
+
+    size_t len = strlen(text);
+    memcpy(bitmap.text, text, len + 1);
+    return true;
+}
+
+int OSDFont::calculateTextSize(const char *text, uint16_t &width, uint16_t &height)
+{
+    width = 0;
+    height = 0;
+
+    while (*text)
+    {
+        if (const Glyph *g = glyph(next_codepoint(text)))
+        {
+            width += g->advance + (outline * 2);
+            if (g->height > height)
+            {
+                height = g->height;
+            }
+        }
+    }
+
+    height += yScale;
+    width += 1 + outline;
+
+    return 0;
+}
+
+void OSDFont::measure(const char *text, uint16_t &width, uint16_t &height)
+{
+    prepare(text);
+    calculateTextSize(text, width, height);
+
+    if (width % 2 != 0)
+        ++width;
+}
+
+/* draw the text into the bitmap. unchanged text is kept, text with the
+ * same layout only redraws the changed glyphs.
+ */
+void OSDFont::render(OSDBitmap &bitmap, const char *text, int angle)
+{
+    if (angle == bitmap.angle && bitmap.text[0] && strcmp(text, bitmap.text) == 0)
+        return;
+
+    prepare(text);
+
+    uint16_t item_width = 0;
+    uint16_t item_height = 0;
+
+    calculateTextSize(text, item_width, item_height);
+
+    if (item_width % 2 != 0)
+        ++item_width;
+
+    bitmap.serial++;
+
+    // same size as before, only the changed glyphs are drawn again
+    if (!angle && !bitmap.angle && item_width == bitmap.width &&
+        item_height == bitmap.height && updateText(bitmap, text))
+    {
+        return;
+    }
+
+    // the buffer is kept as long as the size doesn't change.
+    // rotated text is drawn into a scratch buffer and rotated into it
+    int item_size = item_width * item_height * 4;
+    uint8_t *target;
+    if (angle)
+    {
+        scratch.assign(item_size, 0);
+        target = scratch.data();
+    }
+    else
+    {
+        if (item_size != bitmap.size)
+        {
+            free(bitmap.data);
+            bitmap.data = (uint8_t *)malloc(item_size);
+            bitmap.size = item_size;
+        }
+        memset(bitmap.data, 0, item_size);
+        target = bitmap.data;
+    }
+
+    drawText(target, text, item_width, item_height, 0, item_width);
+
+    if (angle)
+    {
+        rotateBGRAImage(target, item_width, item_height, angle, bitmap.data, bitmap.size);
+    }
+
+    bitmap.width = item_width;
+    bitmap.height = item_height;
+    bitmap.angle = angle;
+
+    if (strlen(text) < sizeof(bitmap.text))
+        strcpy(bitmap.text, text);
+    else
+        bitmap.text[0] = 0;
+}
+
+/* rotate a BGRA image clockwise by angle degrees into dst.
+ * dst is reused and only reallocated if it's too small, dstSize holds its
+ * allocated size. width and height are updated to the rotated size.
+ * multiples of 90 are exact copies, other angles step through the source
+ * in 16.16 fixed point, one 32 bit pixel at a time.
+ */
+void OSDFont::rotateBGRAImage(const uint8_t *src, uint16_t &width, uint16_t &height, int angle, uint8_t *&dst, int &dstSize)
+{
+    angle = ((angle % 360) + 360) % 360;
+
+    int newWidth;
+    int newHeight;
+    double angleRad = angle * (M_PI / 180.0);
+    double c = cos(angleRad);
+    double s = sin(angleRad);
+
+    if (angle % 90 == 0)
+    {
+        newWidth = (angle == 90 || angle == 270) ? height : width;
+        newHeight = (angle == 90 || angle == 270) ? width : height;
+    }
+    else
+    {
+        int originalCorners[4][2] = {
+            {0, 0},
+            {width, 0},
+            {0, height},
+            {width, height}};
+
+        int minX = INT_MAX;
+        int maxX = INT_MIN;
+        int minY = INT_MAX;
+        int maxY = INT_MIN;
+
+        for (auto &originalCorner : originalCorners)
+        {
+            int x = originalCorner[0];
+            int y = originalCorner[1];
+
+            int newX = static_cast<int>(x * c - y * s);
+            int newY = static_cast<int>(x * s + y * c);
+
+            minX = std::min(minX, newX);
+            maxX = std::max(maxX, newX);
+            minY = std::min(minY, newY);
+            maxY = std::max(maxY, newY);
+        }
+
+        newWidth = maxX - minX + 1;
+        newHeight = maxY - minY + 1;
+    }
+
+    int size = newWidth * newHeight * 4;
+    if (size > dstSize)
+    {
+        free(dst);
+        dst = (uint8_t *)malloc(size);
+        dstSize = size;
+    }
+
+    const uint32_t *in = (const uint32_t *)src;
+    uint32_t *out = (uint32_t *)dst;
+    int w = width;
+    int h = height;
+
+    switch (angle)
+    {
+    case 0:
+        memcpy(out, in, size);
+        break;
+    case 90:
+        for (int y = 0; y < newHeight; ++y)
+            for (int x = 0; x < newWidth; ++x)
+                *out++ = in[(h - 1 - x) * w + y];
+        break;
+    case 180:
+        for (int y = 0; y < newHeight; ++y)
+            for (int x = 0; x < newWidth; ++x)
+                *out++ = in[(h - 1 - y) * w + (w - 1 - x)];
+        break;
+    case 270:
+        for (int y = 0; y < newHeight; ++y)
+            for (int x = 0; x < newWidth; ++x)
+                *out++ = in[x * w + (w - 1 - y)];
+        break;
+    default:
+    {
+        // source position of the destination pixel, relative to the centers
+        int32_t fc = lround(c * 65536);
+        int32_t fs = lround(s * 65536);
+        int32_t centerX = (w / 2) << 16;
+        int32_t centerY = (h / 2) << 16;
+        int newCenterX = newWidth / 2;
+        int newCenterY = newHeight / 2;
+
+        for (int y = 0; y < newHeight; ++y)
+        {
+            int32_t srcX = -newCenterX * fc + (y - newCenterY) * fs + centerX;
+            int32_t srcY = newCenterX * fs + (y - newCenterY) * fc + centerY;
+            for (int x = 0; x < newWidth; ++x, srcX += fc, srcY -= fs)
+            {
+                int origX = srcX >> 16;
+                int origY = srcY >> 16;
+                *out++ = ((unsigned)origX < (unsigned)w && (unsigned)origY < (unsigned)h)
+                             ? in[origY * w + origX]
+                             : 0;
+            }
+        }
+        break;
+    }
+    }
+
+    width = newWidth;
+    height = newHeight;
+}
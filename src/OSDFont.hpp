@@ -0,0 +1,95 @@
+#ifndef OSDFont_hpp
+#define OSDFont_hpp
+
+#include <array>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Config.hpp"
+#include "schrift.h"
+
+// non ASCII glyphs kept in the atlas
+#define OSD_GLYPH_CACHE_SIZE 256
+
+struct Glyph {
+    bool valid{false};
+    int width;
+    int height;
+    std::vector<uint8_t> coverage;
+    int advance;
+    int xmin;
+    int ymin;
+    SFT_Glyph glyph;
+    // BGRA cell with outline in the atlas
+    size_t offset;
+    int cell_width;
+    int cell_height;
+};
+
+// rendered text of an OSD item, shared by the streams that show it
+struct OSDBitmap
+{
+    uint8_t *data{nullptr};
+    int size{0};
+    uint16_t width{0};
+    uint16_t height{0};
+    int angle{0};
+    // text shown, for partial updates
+    char text[64]{};
+    // changes on every render, the regions compare it with their copy
+    unsigned int serial{0};
+    // second the text was formatted for
+    time_t stamp{0};
+};
+
+/* a font at one size, stroke and color with its glyph atlas.
+ * streams with the same font settings share one instance, the text is
+ * rendered once into a bitmap that all their regions use.
+ */
+class OSDFont
+{
+public:
+    static std::shared_ptr<OSDFont> get(const _osd &osd);
+    ~OSDFont();
+
+    // bitmap of an item, the key names the item, its format and rotation
+    OSDBitmap &bitmap(const std::string &key);
+    void release(const std::string &key);
+    void render(OSDBitmap &bitmap, const char *text, int angle);
+    // size of the unrotated bitmap of a text
+    void measure(const char *text, uint16_t &width, uint16_t &height);
+    int stroke() const { return outline; }
+
+    static void rotateBGRAImage(const uint8_t *src, uint16_t &width, uint16_t &height, int angle, uint8_t *&dst, int &dstSize);
+
+private:
+    OSDFont() = default;
+    int load(const _osd &osd);
+
+    const Glyph *glyph(uint32_t cp) const;
+    void prepare(const char *text);
+    void renderGlyph(uint32_t cp, Glyph &g);
+    void blitGlyph(uint8_t *image, const Glyph &g, int x, int y, int WIDTH, int HEIGHT, int clipX0, int clipX1);
+    int calculateTextSize(const char *text, uint16_t &width, uint16_t &height);
+    int drawText(uint8_t *image, const char *text, int WIDTH, int HEIGHT, int clipX0, int clipX1);
+    bool updateText(OSDBitmap &bitmap, const char *text);
+
+    SFT sft{};
+    std::array<Glyph, 128> ascii;
+    std::unordered_map<uint32_t, Glyph> extra;
+    std::vector<uint8_t> atlas;
+    size_t ascii_atlas_size{0};
+    std::vector<std::pair<int, int>> disk;
+    // unrotated text of a rotated item
+    std::vector<uint8_t> scratch;
+    std::unordered_map<std::string, OSDBitmap> bitmaps;
+
+    int outline{0};
+    int yScale{0};
+    uint8_t BGRA_STROKE[4];
+    uint8_t BGRA_TEXT[4];
+};
+
+#endif
@@ -0,0 +1,330 @@
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "OSDRegions.hpp"
+#include "Config.hpp"
+#include "Logger.hpp"
+
+#define MODULE "OSDRegions"
+
+// both video streams
+#define OSD_REGION_STREAMS 2
+
+static OSDRegion table[OSD_REGION_STREAMS * OSD_MAX_REGIONS];
+static unsigned int change_count = 0;
+static unsigned int next_version = 1;
+static std::mutex regions_mutex;
+static std::condition_variable regions_changed;
+
+static const char *const state_names[] = {
+    "pending",
+    "shown",
+    "no pool memory",
+    "invalid"};
+
+const char *OSDRegions::stateName(OSDRegionState state)
+{
+    return state_names[state];
+}
+
+// entry of a name, nullptr if unknown. needs regions_mutex
+static OSDRegion *find(const char *name)
+{
+    for (OSDRegion &r : table)
+    {
+        if (r.name[0] && strcmp(r.name, name) == 0)
+            return &r;
+    }
+    return nullptr;
+}
+
+static bool valid(const OSDRegion &region)
+{
+    if (!region.name[0] || region.stream < 0 || region.stream >= OSD_REGION_STREAMS)
+        return false;
+    if (region.rotation < 0 || region.rotation > 360 || region.transparency < 0 || region.transparency > 255)
+        return false;
+    // text or image, not both
+    if (!region.text[0] == !region.image[0])
+        return false;
+    if (region.image[0] && (region.width <= 0 || region.height <= 0))
+        return false;
+    return true;
+}
+
+bool OSDRegions::set(const OSDRegion &region)
+{
+    if (!valid(region))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(regions_mutex);
+
+        OSDRegion *entry = find(region.name);
+        if (entry && entry->stream != region.stream)
+        {
+            // moved to the other stream, drop it there first
+            entry->name[0] = 0;
+            entry = nullptr;
+        }
+
+        if (!entry)
+        {
+            int count = 0;
+            for (OSDRegion &r : table)
+            {
+                if (r.name[0] && r.stream == region.stream)
+                    count++;
+                else if (!r.name[0] && !entry)
+                    entry = &r;
+            }
+            if (!entry || count >= OSD_MAX_REGIONS)
+                return false;
+        }
+        else if (strcmp(entry->text, region.text) == 0 && strcmp(entry->image, region.image) == 0 &&
+                 entry->x == region.x && entry->y == region.y && entry->rotation == region.rotation &&
+                 entry->transparency == region.transparency && entry->width == region.width &&
+                 entry->height == region.height)
+        {
+            // unchanged, nothing to render
+            return true;
+        }
+
+        *entry = region;
+        entry->version = next_version++;
+        entry->state = OSD_REGION_PENDING;
+        change_count++;
+    }
+
+    regions_changed.notify_all();
+    return true;
+}
+
+bool OSDRegions::remove(const char *name)
+{
+    {
+        std::lock_guard<std::mutex> lock(regions_mutex);
+        OSDRegion *entry = find(name);
+        if (!entry)
+            return false;
+
+        entry->name[0] = 0;
+        change_count++;
+    }
+
+    regions_changed.notify_all();
+    return true;
+}
+
+bool OSDRegions::get(const char *name, OSDRegion &region)
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    OSDRegion *entry = find(name);
+    if (!entry)
+        return false;
+
+    region = *entry;
+    return true;
+}
+
+int OSDRegions::list(int stream, OSDRegion (&regions)[OSD_MAX_REGIONS])
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    int count = 0;
+    for (OSDRegion &r : table)
+    {
+        if (r.name[0] && r.stream == stream && count < OSD_MAX_REGIONS)
+            regions[count++] = r;
+    }
+    return count;
+}
+
+void OSDRegions::report(const char *name, unsigned int version, OSDRegionState state)
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    OSDRegion *entry = find(name);
+    // the state of an older version is outdated
+    if (entry && entry->version == version)
+        entry->state = state;
+}
+
+unsigned int OSDRegions::changes()
+{
+    std::lock_guard<std::mutex> lock(regions_mutex);
+    return change_count;
+}
+
+void OSDRegions::wait(const struct timespec &deadline, unsigned int seen)
+{
+    auto until = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(deadline.tv_sec) + std::chrono::nanoseconds(deadline.tv_nsec)));
+
+    std::unique_lock<std::mutex> lock(regions_mutex);
+    regions_changed.wait_until(lock, until, [seen] { return change_count != seen; });
+}
+
+/* parse "set NAME key=value ...", the text takes the rest of the line.
+ * keys: stream, x, y, rotation, transparency, image, width, height, text
+ */
+static bool parse_set(char *args, OSDRegion &region)
+{
+    char *save = nullptr;
+    char *name = strtok_r(args, " ", &save);
+    if (!name || strlen(name) >= sizeof(region.name))
+        return false;
+
+    // an update keeps the values that are not given
+    if (!OSDRegions::get(name, region))
+    {
+        region = OSDRegion{};
+        strcpy(region.name, name);
+    }
+
+    char *token;
+    while ((token = strtok_r(nullptr, " ", &save)))
+    {
+        char *value = strchr(token, '=');
+        if (!value)
+            return false;
+        *value++ = 0;
+
+        if (strcmp(token, "text") == 0)
+        {
+            // rest of the line, strtok_r has cut it at the next space
+            if (save && *save)
+                value[strlen(value)] = ' ';
+            if (strlen(value) >= sizeof(region.text))
+                return false;
+            strcpy(region.text, value);
+            region.image[0] = 0;
+            break;
+        }
+        else if (strcmp(token, "image") == 0)
+        {
+            if (strlen(value) >= sizeof(region.image))
+                return false;
+            strcpy(region.image, value);
+            region.text[0] = 0;
+        }
+        else if (strcmp(token, "stream") == 0)
+            region.stream = atoi(value);
+        else if (strcmp(token, "x") == 0)
+            region.x = atoi(value);
+        else if (strcmp(token, "y") == 0)
+            region.y = atoi(value);
+        else if (strcmp(token, "rotation") == 0)
+            region.rotation = atoi(value);
+        else if (strcmp(token, "transparency") == 0)
+            region.transparency = atoi(value);
+        else if (strcmp(token, "width") == 0)
+            region.width = atoi(value);
+        else if (strcmp(token, "height") == 0)
+            region.height = atoi(value);
+        else
+            return false;
+    }
+    return true;
+}
+
+/* commands, one per datagram:
+ *   set NAME [stream=N] [x=X] [y=Y] [rotation=R] [transparency=T] text=TEXT
+ *   set NAME [stream=N] [x=X] [y=Y] image=PATH width=W height=H
+ *   get NAME
+ *   del NAME
+ * the reply is sent back if the client has bound an address.
+ */
+static void handle_command(char *cmd, char *reply, size_t reply_size)
+{
+    OSDRegion region;
+
+    // one line, a trailing newline of echo or socat is dropped
+    cmd[strcspn(cmd, "\r\n")] = 0;
+
+    if (strncmp(cmd, "set ", 4) == 0)
+    {
+        bool ok = parse_set(cmd + 4, region) && OSDRegions::set(region);
+        snprintf(reply, reply_size, ok ? "ok" : "error");
+    }
+    else if (strncmp(cmd, "get ", 4) == 0)
+    {
+        cmd[4 + strcspn(cmd + 4, " ")] = 0;
+        if (OSDRegions::get(cmd + 4, region))
+            snprintf(reply, reply_size, "%s", OSDRegions::stateName(region.state));
+        else
+            snprintf(reply, reply_size, "error");
+    }
+    else if (strncmp(cmd, "del ", 4) == 0)
+    {
+        cmd[4 + strcspn(cmd + 4, " ")] = 0;
+        snprintf(reply, reply_size, OSDRegions::remove(cmd + 4) ? "ok" : "error");
+    }
+    else
+    {
+        snprintf(reply, reply_size, "error");
+    }
+}
+
+void *OSDRegions::socket_thread(void *arg)
+{
+    const char *path = cfg->general.osd_socket;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("OSD socket: " << strerror(errno));
+        return nullptr;
+    }
+
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        LOG_ERROR("OSD socket path too long: " << path);
+        close(fd);
+        return nullptr;
+    }
+    strcpy(addr.sun_path, path);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOG_ERROR("OSD socket bind " << path << ": " << strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    LOG_INFO("OSD region socket listening on " << path);
+
+    char cmd[OSD_REGION_TEXT_SIZE * 2 + 128];
+    char reply[32];
+    while (true)
+    {
+        struct sockaddr_un peer{};
+        socklen_t peer_len = sizeof(peer);
+        ssize_t len = recvfrom(fd, cmd, sizeof(cmd) - 1, 0, (struct sockaddr *)&peer, &peer_len);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("OSD socket recvfrom: " << strerror(errno));
+            break;
+        }
+        cmd[len] = 0;
+
+        handle_command(cmd, reply, sizeof(reply));
+        LOG_DEBUG("OSD socket: " << cmd << " -> " << reply);
+
+        if (peer_len > sizeof(sa_family_t))
+            sendto(fd, reply, strlen(reply), 0, (struct sockaddr *)&peer, peer_len);
+    }
+
+    close(fd);
+    return nullptr;
+}
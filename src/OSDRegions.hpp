@@ -0,0 +1,67 @@
+#ifndef OSDRegions_hpp
+#define OSDRegions_hpp
+
+#include <cstdint>
+#include <ctime>
+
+// dynamic regions per stream
+#define OSD_MAX_REGIONS 8
+#define OSD_REGION_NAME_SIZE 32
+#define OSD_REGION_TEXT_SIZE 128
+
+enum OSDRegionState
+{
+    OSD_REGION_PENDING,
+    OSD_REGION_SHOWN,
+    OSD_REGION_NO_POOL,
+    OSD_REGION_INVALID
+};
+
+/* a text or image region created at runtime by the API.
+ * an image is a raw BGRA file of width x height, like the logo.
+ */
+struct OSDRegion
+{
+    char name[OSD_REGION_NAME_SIZE]{};
+    int stream{0};
+    int x{0};
+    int y{0};
+    int rotation{0};
+    int transparency{255};
+    char text[OSD_REGION_TEXT_SIZE]{};
+    char image[OSD_REGION_TEXT_SIZE]{};
+    int width{0};
+    int height{0};
+    // changes with every update of the region, set by the manager
+    unsigned int version{0};
+    // set by the OSD of the stream
+    OSDRegionState state{OSD_REGION_PENDING};
+};
+
+/* regions shared between the API (websocket, local socket) and the OSD
+ * thread. the API replaces definitions, the OSD thread applies them to its
+ * IMP regions and reports the state back. content is only rendered again
+ * if the version of a region has changed.
+ */
+class OSDRegions
+{
+public:
+    // create or update a region, false if the table is full or it's invalid
+    static bool set(const OSDRegion &region);
+    static bool remove(const char *name);
+    static bool get(const char *name, OSDRegion &region);
+    static const char *stateName(OSDRegionState state);
+
+    // regions of a stream, returns the count
+    static int list(int stream, OSDRegion (&regions)[OSD_MAX_REGIONS]);
+    static void report(const char *name, unsigned int version, OSDRegionState state);
+    // changes with every set or remove
+    static unsigned int changes();
+    // sleep until the realtime deadline or until a region changes
+    static void wait(const struct timespec &deadline, unsigned int seen);
+
+    // local datagram socket, one command per datagram
+    static void *socket_thread(void *arg);
+};
+
+#endif
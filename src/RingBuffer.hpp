@@ -63,8 +63,18 @@ public:
         size -= count;
     }
 
+    // drop the oldest bytes
+    void discard(size_t count)
+    {
+        count = count < size ? count : size;
+        head = (head + count) % capacity;
+        size -= count;
+    }
+
     bool isEmpty() const { return size == 0; }
     size_t getSize() const { return size; }
+    size_t getFree() const { return capacity - size; }
+    size_t getCapacity() const { return capacity; }
 
 private:
     uint8_t* buffer;
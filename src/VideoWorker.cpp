@@ -1,14 +1,22 @@
 #include "VideoWorker.hpp"
 
+#include <algorithm>
+
 #include "Config.hpp"
 #include "IMPEncoder.hpp"
 #include "IMPFramesource.hpp"
 #include "Logger.hpp"
+#include "Motion.hpp"
 #include "WorkerUtils.hpp"
 #include "globals.hpp"
 
 #define MODULE "VideoWorker"
 
+// encoder ROI windows of the T31 and newer
+#define VIDEO_ROI_WINDOWS 16
+// minimum time between two ROI updates in ms
+#define VIDEO_ROI_INTERVAL 500
+
 VideoWorker::VideoWorker(int chn)
     : encChn(chn)
 {
@@ -20,6 +28,121 @@ VideoWorker::~VideoWorker()
     LOG_DEBUG("VideoWorker destroyed for channel " << encChn);
 }
 
+/* economy profile after idle_delay seconds without motion, the full
+ * profile of the stream right at the start of a motion. motion is false
+ * while no detector runs. changed idle rates apply to an idle stream too.
+ * encoders that keep their bitrate would spend it on fewer frames, they
+ * don't get the profile.
+ */
+void VideoWorker::updateProfile(const _stream &stream, bool motion)
+{
+    IMPEncoder *encoder = global_video[encChn]->imp_encoder;
+    bool enabled = motion && stream.idle_fps > 0 && encoder && strcmp(stream.format, "JPEG") != 0;
+    if (enabled && !IMPEncoder::canChangeBitrate())
+    {
+        if (!idleUnsupported)
+            LOG_WARN("Stream " << encChn << " idle profile ignored, the encoder can't change the bitrate");
+        idleUnsupported = true;
+        enabled = false;
+    }
+
+    auto now = steady_clock::now();
+    if (!enabled || global_motion_active)
+        lastMotion = now;
+
+    bool idle = enabled && duration_cast<seconds>(now - lastMotion).count() >= stream.idle_delay;
+
+    // the encoder can't go above the rates the channel was created with
+    int fps = std::min(stream.idle_fps, stream.fps);
+    int bitrate = stream.idle_bitrate ? std::min(stream.idle_bitrate, stream.bitrate) : stream.bitrate;
+    int gop = std::min(stream.idle_gop ? stream.idle_gop : stream.gop, stream.max_gop);
+
+    if (idle == economy && (!idle || (fps == idleFps && bitrate == idleBitrate && gop == idleGop)))
+        return;
+    bool changed = idle != economy;
+    economy = idle;
+
+    if (idle)
+    {
+        LOG_INFO("Stream " << encChn << " idle, " << fps << "fps, " << bitrate << "kbps, gop " << gop);
+        encoder->setRate(fps, bitrate, gop);
+        idleFps = fps;
+        idleBitrate = bitrate;
+        idleGop = gop;
+    }
+    else
+    {
+        LOG_INFO("Stream " << encChn << " active, " << stream.fps << "fps, " << stream.bitrate << "kbps");
+        encoder->setRate(stream.fps, stream.bitrate, stream.gop);
+    }
+
+    if (changed && stream.idle_idr)
+        IMP_Encoder_RequestIDR(encChn);
+}
+
+/* encoder ROI windows over the motion regions, the ones with motion get
+ * roi_qp_motion and the others roi_qp_static. updated at most every
+ * VIDEO_ROI_INTERVAL ms and only if a region or one of the QPs has changed.
+ */
+void VideoWorker::updateRoi(const _stream &stream, bool motion)
+{
+    IMPEncoder *encoder = global_video[encChn]->imp_encoder;
+    if (!encoder)
+        return;
+
+    bool enabled = motion && (stream.roi_qp_motion || stream.roi_qp_static) && strcmp(stream.format, "JPEG") != 0;
+    if (!enabled)
+    {
+        for (int i = 0; i < roiWindows; i++)
+            encoder->setRoi(i, nullptr, 0);
+        roiWindows = 0;
+        roiVersion = 0;
+        roiQpMotion = 0;
+        roiQpStatic = 0;
+        return;
+    }
+
+    auto now = steady_clock::now();
+    if (duration_cast<milliseconds>(now - lastRoi).count() < VIDEO_ROI_INTERVAL)
+        return;
+    lastRoi = now;
+
+    MotionRegions regions;
+    Motion::regions(regions);
+    if (regions.frameWidth <= 0 || regions.frameHeight <= 0)
+        return;
+    if (regions.version == roiVersion && stream.roi_qp_motion == roiQpMotion && stream.roi_qp_static == roiQpStatic)
+        return;
+    roiVersion = regions.version;
+    roiQpMotion = stream.roi_qp_motion;
+    roiQpStatic = stream.roi_qp_static;
+
+    // moving regions first, the encoder has a few windows only
+    int windows = 0;
+    for (bool active : {true, false})
+    {
+        int qp = active ? stream.roi_qp_motion : stream.roi_qp_static;
+        for (int n = 0; n < regions.count && qp && windows < VIDEO_ROI_WINDOWS; n++)
+        {
+            if (regions.active[n] != active)
+                continue;
+
+            // motion frame to stream pixels, aligned to the 16 pixel macroblocks
+            const roi &r = regions.rect[n];
+            roi rect{};
+            rect.p0_x = (r.p0_x * stream.width / regions.frameWidth) & ~15;
+            rect.p0_y = (r.p0_y * stream.height / regions.frameHeight) & ~15;
+            rect.p1_x = std::min(((r.p1_x + 1) * stream.width / regions.frameWidth + 15) & ~15, stream.width) - 1;
+            rect.p1_y = std::min(((r.p1_y + 1) * stream.height / regions.frameHeight + 15) & ~15, stream.height) - 1;
+            encoder->setRoi(windows++, &rect, qp);
+        }
+    }
+
+    for (int i = windows; i < roiWindows; i++)
+        encoder->setRoi(i, nullptr, 0);
+    roiWindows = windows;
+}
+
 void VideoWorker::run()
 {
     LOG_DEBUG("Start video processing run loop for stream " << encChn);
@@ -32,6 +155,15 @@ void VideoWorker::run()
 
     while (global_video[encChn]->running)
     {
+        // config values stay the same for this iteration
+        CFGSnapshotRef snap = cfg->snapshot();
+
+        // motion.enabled alone doesn't mean a detector runs, init may have failed
+        const _stream &config = encChn == 0 ? snap->stream0 : snap->stream1;
+        bool motion = snap->motion.enabled && global_motion_thread_signal;
+        updateProfile(config, motion);
+        updateRoi(config, motion);
+
         /* bool helper to check if this is the active jpeg channel and a jpeg is requested while 
          * the channel is inactive
          */
@@ -43,7 +175,7 @@ void VideoWorker::run()
          */
         if (global_video[encChn]->hasDataCallback || run_for_jpeg)
         {
-            if (IMP_Encoder_PollingStream(encChn, cfg->general.imp_polling_timeout) == 0)
+            if (IMP_Encoder_PollingStream(encChn, snap->general.imp_polling_timeout) == 0)
             {
                 IMPEncoderStream stream;
                 if (IMP_Encoder_GetStream(encChn, &stream, GET_STREAM_BLOCKING) != 0)
@@ -142,10 +274,10 @@ void VideoWorker::run()
                          * and the audio grabber and encoder standby is also controlled by the video threads
                          * we need to wakeup the audio thread 
                         */
-                        if (cfg->audio.input_enabled && !global_audio[0]->active && !global_restart)
+                        if (snap->audio.input_enabled && !global_audio[0]->active && !global_restart)
                         {
                             LOG_DDEBUG("NOTIFY AUDIO " << !global_audio[0]->active << " "
-                                                       << cfg->audio.input_enabled);
+                                                       << snap->audio.input_enabled);
                             global_audio[0]->should_grab_frames.notify_one();
                         }
 #endif
@@ -154,22 +286,16 @@ void VideoWorker::run()
 
                 IMP_Encoder_ReleaseStream(encChn, &stream);
 
-                ms = WorkerUtils::tDiffInMs(&global_video[encChn]->stream->stats.ts);
+                ms = WorkerUtils::tDiffInMs(&global_video[encChn]->stats.ts);
                 if (ms > 1000)
                 {
-                    /* currently we write into osd and stream stats,
-                     * osd will be removed and redesigned in future
-                    */
-                    global_video[encChn]->stream->stats.bps = bps;
-                    global_video[encChn]->stream->osd.stats.bps = bps;
-                    global_video[encChn]->stream->stats.fps = fps;
-                    global_video[encChn]->stream->osd.stats.fps = fps;
+                    // the osd reads them from here too
+                    global_video[encChn]->stats.bps = bps;
+                    global_video[encChn]->stats.fps = fps;
 
                     fps = 0;
                     bps = 0;
-                    gettimeofday(&global_video[encChn]->stream->stats.ts, NULL);
-                    global_video[encChn]->stream->osd.stats.ts = global_video[encChn]
-                                                                     ->stream->stats.ts;
+                    gettimeofday(&global_video[encChn]->stats.ts, NULL);
                     /*
                     IMPEncoderCHNStat encChnStats;
                     IMP_Encoder_Query(channel->encChn, &encChnStats);
@@ -192,7 +318,7 @@ void VideoWorker::run()
             {
                 error_count++;
                 LOG_DDEBUG("IMP_Encoder_PollingStream("
-                           << encChn << ", " << cfg->general.imp_polling_timeout << ") timeout !");
+                           << encChn << ", " << snap->general.imp_polling_timeout << ") timeout !");
             }
         }
         else if (global_video[encChn]->onDataCallback == nullptr && !global_restart_video
@@ -203,10 +329,8 @@ void VideoWorker::run()
                                     << " restartVideo:" << global_restart_video
                                     << " runForJpeg:" << global_video[encChn]->run_for_jpeg);
 
-            global_video[encChn]->stream->stats.bps = 0;
-            global_video[encChn]->stream->stats.fps = 0;
-            global_video[encChn]->stream->osd.stats.bps = 0;
-            global_video[encChn]->stream->osd.stats.fps = 0;
+            global_video[encChn]->stats.bps = 0;
+            global_video[encChn]->stats.fps = 0;
 
             std::unique_lock<std::mutex> lock_stream{mutex_main};
             global_video[encChn]->active = false;
@@ -1,6 +1,9 @@
 #ifndef VIDEO_WORKER_HPP
 #define VIDEO_WORKER_HPP
 
+#include <chrono>
+#include "Config.hpp"
+
 class VideoWorker
 {
 public:
@@ -11,8 +14,24 @@ public:
 
 private:
     void run();
+    void updateProfile(const _stream &stream, bool motion);
+    void updateRoi(const _stream &stream, bool motion);
 
     int encChn;
+    // economy profile set on the encoder and the rates it was set with
+    bool economy{false};
+    int idleFps{0};
+    int idleBitrate{0};
+    int idleGop{0};
+    // the idle profile is configured but the encoder doesn't support it, logged once
+    bool idleUnsupported{false};
+    std::chrono::steady_clock::time_point lastMotion{std::chrono::steady_clock::now()};
+    // encoder ROI windows in use, the motion regions and QPs they were set for
+    int roiWindows{0};
+    unsigned int roiVersion{0};
+    int roiQpMotion{0};
+    int roiQpStatic{0};
+    std::chrono::steady_clock::time_point lastRoi;
 };
 
 #endif // VIDEO_PROCESSOR_HPP
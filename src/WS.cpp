@@ -1,8 +1,12 @@
 #include "WS.hpp"
+#include "JsonWriter.hpp"
+#include <algorithm>
+#include <array>
 #include <random>
 #include <set>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <variant>
 #include "Config.hpp"
 #include "libwebsockets.h"
@@ -10,6 +14,8 @@
 #include <imp/imp_isp.h>
 #include <imp/imp_audio.h>
 #include "OSD.hpp"
+#include "OSDRegions.hpp"
+#include "MotionStats.hpp"
 #include "globals.hpp"
 #include <filesystem>
 #include <sys/inotify.h>
@@ -60,11 +66,15 @@ enum
     PNT_FLAG_ROI_ARRAY = 2,
     PNT_FLAG_ROI_ENTRY = 4,
 
+    PNT_FLAG_OSD_REGION_DELETE = 8,
+    PNT_FLAG_OSD_REGION_MODIFIED = 256,
+
+    PNT_FLAG_WS_RX_PAUSED = 16,
+
     PNT_FLAG_RESTART_RTSP = 32,
     PNT_FLAG_RESTART_VIDEO = 64,
     PNT_FLAG_RESTART_AUDIO = 128,
 
-    PNT_FLAG_WS_REQUEST_PENDING = 256,
     PNT_FLAG_WS_PREVIEW_PENDING = 512,
     PNT_FLAG_WS_REQUEST_PREVIEW = 1024,
     PNT_FLAG_WS_SEND_PREVIEW = 2048,
@@ -88,7 +98,9 @@ enum
     PNT_STREAM2,
     PNT_MOTION,
     PNT_INFO,
-    PNT_ACTION
+    PNT_ACTION,
+    PNT_SUBSCRIBE,
+    PNT_OSD_REGION
 };
 
 static const char *const root_keys[] = {
@@ -102,20 +114,26 @@ static const char *const root_keys[] = {
     "stream2",
     "motion",
     "info",
-    "action"};
+    "action",
+    "subscribe",
+    "osd_region"};
 
 /* GENERAL */
 enum
 {
     PNT_GENERAL_LOGLEVEL = 1,
     PNT_GENERAL_OSD_POOL_SIZE,
-    PNT_GENERAL_IMP_POLLING_TIMEOUT
+    PNT_GENERAL_IMP_POLLING_TIMEOUT,
+    PNT_GENERAL_MODULE_LOGLEVELS,
+    PNT_GENERAL_OSD_POOL_RESERVE
 };
 
 static const char *const general_keys[] = {
     "loglevel",
     "osd_pool_size",
-    "imp_polling_timeout"};
+    "imp_polling_timeout",
+    "module_loglevels",
+    "osd_pool_reserve"};
 
 /* RTSP */
 enum
@@ -225,7 +243,8 @@ enum
     PNT_AUDIO_INPUT_FORMAT,
     PNT_AUDIO_INPUT_SAMPLE_RATE,
     PNT_AUDIO_OUTPUT_ENABLED,
-    PNT_AUDIO_OUTPUT_SAMPLE_RATE
+    PNT_AUDIO_OUTPUT_SAMPLE_RATE,
+    PNT_AUDIO_INPUT_FRAME_DURATION
 };
 
 static const char *const audio_keys[] = {
@@ -242,7 +261,8 @@ static const char *const audio_keys[] = {
     "input_format",
     "input_sample_rate",
     "output_enabled",
-    "output_sample_rate"};
+    "output_sample_rate",
+    "input_frame_duration"};
 #endif
 
 /* STREAM */
@@ -266,6 +286,13 @@ enum
     PNT_STREAM_SCALE_WIDTH,
     PNT_STREAM_SCALE_HEIGHT,
     PNT_STREAM_PROFILE,
+    PNT_STREAM_IDLE_FPS,
+    PNT_STREAM_IDLE_BITRATE,
+    PNT_STREAM_IDLE_GOP,
+    PNT_STREAM_IDLE_DELAY,
+    PNT_STREAM_ROI_QP_MOTION,
+    PNT_STREAM_ROI_QP_STATIC,
+    PNT_STREAM_IDLE_IDR,
     PNT_STREAM_STATS,
     PNT_STREAM_OSD
 };
@@ -289,6 +316,13 @@ static const char *const stream_keys[] = {
     "scale_width",
     "scale_height",
     "profile",
+    "idle_fps",
+    "idle_bitrate",
+    "idle_gop",
+    "idle_delay",
+    "roi_qp_motion",
+    "roi_qp_static",
+    "idle_idr",
     "stats",
     "osd"};
 
@@ -438,11 +472,15 @@ static const char *const motion_keys[] = {
 /* INFO */
 enum
 {
-    PNT_INFO_IMP_SYSTEM_VERSION = 1
+    PNT_INFO_IMP_SYSTEM_VERSION = 1,
+    PNT_INFO_MOTION_HEATMAP,
+    PNT_INFO_AUDIO_PIPELINE
 };
 
 static const char *const info_keys[] = {
-    "imp_system_version"};
+    "imp_system_version",
+    "motion_heatmap",
+    "audio_pipeline"};
 
 /* ACTION */
 enum
@@ -464,10 +502,71 @@ static const char *const action_keys[] = {
     "save_config",
     "capture"};
 
+/* SUBSCRIBE */
+enum
+{
+    PNT_SUBSCRIBE_STATS = 1,
+    PNT_SUBSCRIBE_MOTION,
+    PNT_SUBSCRIBE_RESTART,
+    PNT_SUBSCRIBE_AUDIO,
+    PNT_SUBSCRIBE_INTERVAL
+};
+
+/* subscription topics, the bit is (1 << (PNT_SUBSCRIBE_X - 1)) */
+enum
+{
+    PNT_TOPIC_STATS = 1,
+    PNT_TOPIC_MOTION = 2,
+    PNT_TOPIC_RESTART = 4,
+    PNT_TOPIC_AUDIO = 8
+};
+
+static const char *const subscribe_keys[] = {
+    "stats",
+    "motion",
+    "restart",
+    "audio",
+    "interval"};
+
+/* OSD_REGION */
+enum
+{
+    PNT_OSD_REGION_NAME = 1,
+    PNT_OSD_REGION_STREAM,
+    PNT_OSD_REGION_X,
+    PNT_OSD_REGION_Y,
+    PNT_OSD_REGION_ROTATION,
+    PNT_OSD_REGION_TRANSPARENCY,
+    PNT_OSD_REGION_WIDTH,
+    PNT_OSD_REGION_HEIGHT,
+    PNT_OSD_REGION_TEXT,
+    PNT_OSD_REGION_IMAGE,
+    PNT_OSD_REGION_DELETE,
+    PNT_OSD_REGION_STATE
+};
+
+static const char *const osd_region_keys[] = {
+    "name",
+    "stream",
+    "x",
+    "y",
+    "rotation",
+    "transparency",
+    "width",
+    "height",
+    "text",
+    "image",
+    "delete",
+    "state"};
+
 #pragma endregion keys_and_enums
 
 char token[WEBSOCKET_TOKEN_LENGTH + 1]{0};
 
+// context of the running server, used by WS::notify() from other threads
+static struct lws_context *ws_context = nullptr;
+static std::mutex ws_context_lock;
+
 struct snapshot_info
 {
     int r;             // current requests
@@ -476,6 +575,70 @@ struct snapshot_info
     steady_clock::time_point last_snapshot_request;
 };
 
+/* outbound websocket messages, one entry per frame.
+ * every slot keeps LWS_PRE bytes of headroom in front of the payload, so lws_write
+ * can be called on it directly. slot buffers are exchanged with the session
+ * JsonWriter and reused.
+ */
+struct send_queue
+{
+    std::array<std::vector<unsigned char>, WS_SEND_QUEUE_DEPTH> slots;
+    std::array<size_t, WS_SEND_QUEUE_DEPTH> lengths{};
+    size_t head{0};
+    size_t count{0};
+
+    bool empty() const { return count == 0; }
+    bool full() const { return count == WS_SEND_QUEUE_DEPTH; }
+
+    /* take over the buffer of a finished message without copying it,
+     * the writer gets the (already allocated) buffer of the free slot back
+     */
+    bool push(JsonWriter &msg)
+    {
+        if (full())
+            return false;
+
+        size_t tail = (head + count) % WS_SEND_QUEUE_DEPTH;
+        lengths[tail] = msg.size();
+        msg.swap(slots[tail]);
+        count++;
+        return true;
+    }
+
+    unsigned char *front(size_t &len)
+    {
+        len = lengths[head];
+        return slots[head].data() + LWS_PRE;
+    }
+
+    void pop()
+    {
+        head = (head + 1) % WS_SEND_QUEUE_DEPTH;
+        count--;
+    }
+};
+
+/* push updates for subscribed topics, the last sent values are
+ * kept to only send updates if something has changed
+ */
+struct subscription_info
+{
+    int topics;                     // subscribed PNT_TOPIC_* bitmask
+    int sent;                       // topics with an initial value already sent
+    int interval;                   // push interval in milliseconds
+    int fps[NUM_VIDEO_CHANNELS];
+    int bps[NUM_VIDEO_CHANNELS];
+    unsigned int motion_events;
+    int restart;
+    int audio_level;
+    lws_usec_t last_push;
+};
+
+struct user_ctx;
+
+// sessions with active subscriptions, only used on the lws service thread
+static std::set<user_ctx *> subscribers;
+
 struct user_ctx
 {
     char id[SESSION_ID_LENGTH + 1]; // +1 for null terminator
@@ -489,15 +652,18 @@ int flag;                           // bitmask info store e.g. JSON separator ("
     int vidx;
     size_t post_data_size;
     std::string rx_message;
-    std::string tx_message;
-    std::string message;
+    struct send_queue tx_queue;
+    JsonWriter message;             // response of the current request
     lws_sorted_usec_list_t sul; // lws Soft Timer
     struct snapshot_info snapshot;
+    lws_sorted_usec_list_t sul_push; // lws Soft Timer for subscriptions
+    struct subscription_info subscription;
+    OSDRegion osd_region;           // osd_region request, applied at the end of the object
 
     user_ctx(const char* session_id, lws *wsi_handle)
         : wsi(wsi_handle), value(0), flag(0),
-          region(), midx(0), vidx(0), post_data_size(0), rx_message(), tx_message(),
-          message(), sul(), snapshot()
+          region(), midx(0), vidx(0), post_data_size(0), rx_message(), tx_queue(),
+          message(LWS_PRE), sul(), snapshot(), sul_push(), subscription()
     {
         strncpy(id, session_id, SESSION_ID_LENGTH);
         id[SESSION_ID_LENGTH] = '\0';
@@ -559,6 +725,29 @@ int restart_threads_by_signal(int &flag)
     return 0;
 }
 
+/* queue a response for the session and request a writable callback.
+ * a client that does not read its responses gets its receive side paused
+ * until the queue has drained, so it can't make us buffer without limits.
+ */
+bool queue_session_msg(user_ctx *u_ctx, JsonWriter &msg)
+{
+    if (!u_ctx->tx_queue.push(msg))
+    {
+        LOG_ERROR("send queue full, message dropped. id:" << u_ctx->id);
+        return false;
+    }
+
+    if (u_ctx->tx_queue.full() && !(u_ctx->flag & PNT_FLAG_WS_RX_PAUSED))
+    {
+        LOG_DDEBUGWS("send queue full, pause receiving. id:" << u_ctx->id);
+        lws_rx_flow_control(u_ctx->wsi, 0);
+        u_ctx->flag |= PNT_FLAG_WS_RX_PAUSED;
+    }
+
+    lws_callback_on_writable(u_ctx->wsi);
+    return true;
+}
+
 bool get_snapshot(std::vector<unsigned char> &image)
 {
     std::ifstream file(global_jpeg[0]->stream->jpeg_path, std::ios::binary);
@@ -582,43 +771,35 @@ bool get_snapshot(std::vector<unsigned char> &image)
     return false;
 }
 
-template <typename... Args>
-void append_session_msg(std::string &ws_send_msg, const char *t, Args &&...a)
-{
-    char message[256];
-    std::memset(message, 0, sizeof(message));
-    std::snprintf(message, sizeof(message), t, std::forward<Args>(a)...);
-    ws_send_msg += message;
+void add_json_null(JsonWriter &message) {
+    message.null();
 }
 
-void add_json_null(std::string &message) {
-    append_session_msg(
-        message, "%s", pnt_ws_msg[PNT_WS_MSG_NULL]);    
+void add_json_bool(JsonWriter &message, bool bl) {
+    message.boolean(bl);
 }
 
-void add_json_bool(std::string &message, bool bl) {
-    append_session_msg(
-        message, "%s", bl ? pnt_ws_msg[PNT_WS_MSG_TRUE] : pnt_ws_msg[PNT_WS_MSG_FALSE]);   
+void add_json_str(JsonWriter &message, const char *value) {
+    message.str(value);
 }
 
-void add_json_str(std::string &message, const char *value) {
-    append_session_msg(
-        message, "\"%s\"", value);   
+void add_json_num(JsonWriter &message, int value) {
+    message.num(value);
 }
 
-void add_json_num(std::string &message, int value) {
-    append_session_msg(
-        message, "%d", value);   
+void add_json_uint(JsonWriter &message, unsigned int value) {
+    message.hex(value);
 }
 
-void add_json_uint(std::string &message, unsigned int value) {
-    append_session_msg(
-        message, "\"%#x\"", value);   
+void add_json_key(JsonWriter &message, bool separator, const char *key, const char * opener = "") {
+    message.key(separator, key, opener);
 }
 
-void add_json_key(std::string &message, bool separator, const char *key, const char * opener = "") {
-    append_session_msg(
-        message, "%s\"%s\":%s", separator ? "," : "", key, opener);
+// values of a motion region without brackets, the optional ones only if set
+void add_json_roi(JsonWriter &message, const roi &r) {
+    message.num(r.p0_x).append(',').num(r.p0_y).append(',').num(r.p1_x).append(',').num(r.p1_y);
+    if (r.has_options())
+        message.append(',').num(r.sensitivity).append(',').num(r.debounce_time).append(',').num(r.cooldown_time);
 }
 
 // Helper function to safely combine path components
@@ -645,7 +826,8 @@ signed char WS::general_callback(struct lejp_ctx *ctx, char reason)
 
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
-        if (ctx->path_match >= PNT_GENERAL_OSD_POOL_SIZE && ctx->path_match <= PNT_GENERAL_IMP_POLLING_TIMEOUT)
+        if ((ctx->path_match >= PNT_GENERAL_OSD_POOL_SIZE && ctx->path_match <= PNT_GENERAL_IMP_POLLING_TIMEOUT) ||
+            ctx->path_match == PNT_GENERAL_OSD_POOL_RESERVE)
         { // integer values
             if (reason == LEJPCB_VAL_NUM_INT)
                 cfg->set<int>(u_ctx->path, atoi(ctx->buf));
@@ -665,6 +847,16 @@ signed char WS::general_callback(struct lejp_ctx *ctx, char reason)
                 }
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));                
                 break;                    
+            case PNT_GENERAL_MODULE_LOGLEVELS:
+                if (reason == LEJPCB_VAL_STR_END)
+                {
+                    if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                    {
+                        Logger::setModuleLevels(ctx->buf);
+                    }
+                }
+                add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
+                break;
             default:
                 u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
                 break;
@@ -1135,7 +1327,8 @@ signed char WS::audio_callback(struct lejp_ctx *ctx, char reason)
         else if (ctx->path_match == PNT_AUDIO_INPUT_NOISE_SUPPRESSION || 
                  ctx->path_match == PNT_AUDIO_INPUT_SAMPLE_RATE ||
                  ctx->path_match == PNT_AUDIO_INPUT_BITRATE ||
-                 ctx->path_match == PNT_AUDIO_OUTPUT_SAMPLE_RATE )
+                 ctx->path_match == PNT_AUDIO_OUTPUT_SAMPLE_RATE ||
+                 ctx->path_match == PNT_AUDIO_INPUT_FRAME_DURATION)
         {
             if (reason == LEJPCB_VAL_NUM_INT)
             {
@@ -1292,7 +1485,7 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
 
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
-        if (ctx->path_match >= PNT_STREAM_GOP && ctx->path_match <= PNT_STREAM_PROFILE)
+        if (ctx->path_match >= PNT_STREAM_GOP && ctx->path_match <= PNT_STREAM_ROI_QP_STATIC)
         { // integer values
             if (reason == LEJPCB_VAL_NUM_INT)
                 cfg->set<int>(u_ctx->path, atoi(ctx->buf));
@@ -1324,6 +1517,17 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
                     cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;                
+            case PNT_STREAM_IDLE_IDR:
+                if (reason == LEJPCB_VAL_TRUE)
+                {
+                    cfg->set<bool>(u_ctx->path, true);
+                }
+                else if (reason == LEJPCB_VAL_FALSE)
+                {
+                    cfg->set<bool>(u_ctx->path, false);
+                }
+                add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
+                break;
             case PNT_STREAM_SCALE_ENABLED:
                 if (reason == LEJPCB_VAL_TRUE)
                 {
@@ -1352,16 +1556,15 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
                     uint32_t bps = 0;
                     if (is_stream(u_ctx->root, "stream0"))
                     {
-                        fps = cfg->stream0.stats.fps;
-                        bps = cfg->stream0.stats.bps;
+                        fps = global_video[0]->stats.fps;
+                        bps = global_video[0]->stats.bps;
                     }
                     else if (is_stream(u_ctx->root, "stream1"))
                     {
-                        fps = cfg->stream1.stats.fps;
-                        bps = cfg->stream1.stats.bps;
+                        fps = global_video[1]->stats.fps;
+                        bps = global_video[1]->stats.bps;
                     }
-                    append_session_msg(
-                        u_ctx->message, "{\"fps\":%d,\"Bps\":%d}", fps, bps);
+                    u_ctx->message.append("{\"fps\":").num(fps).append(",\"Bps\":").num(bps).append('}');
                 }
                 break;                
             default:
@@ -1457,11 +1660,10 @@ signed char WS::stream2_callback(struct lejp_ctx *ctx, char reason)
                 uint32_t bps = 0;
                 if (is_stream(u_ctx->root, "stream2"))
                 {
-                    fps = cfg->stream2.stats.fps;
-                    bps = cfg->stream2.stats.bps;
+                    fps = global_jpeg[0]->stats.fps;
+                    bps = global_jpeg[0]->stats.bps;
                 }
-                append_session_msg(
-                    u_ctx->message, "{\"fps\":%d,\"Bps\":%d}", fps, bps);
+                u_ctx->message.append("{\"fps\":").num(fps).append(",\"Bps\":").num(bps).append('}');
             }
             break;
         default:
@@ -1753,9 +1955,9 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
             if ((u_ctx->flag & PNT_FLAG_SEPARATOR))
                 u_ctx->message.append(",");
 
-            append_session_msg(
-                u_ctx->message, "[%d,%d,%d,%d]", cfg->motion.rois[i].p0_x, cfg->motion.rois[i].p0_y,
-                cfg->motion.rois[i].p1_x, cfg->motion.rois[i].p1_y);
+            u_ctx->message.append('[');
+            add_json_roi(u_ctx->message, cfg->motion.rois[i]);
+            u_ctx->message.append(']');
             u_ctx->flag |= PNT_FLAG_SEPARATOR;
         }
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
@@ -1777,6 +1979,7 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
             {
                 u_ctx->flag |= PNT_FLAG_ROI_ENTRY; // entry array
                 u_ctx->vidx = 0;                   // entry array index
+                u_ctx->region = roi{};
                 u_ctx->message.append("[");
             }
             // roi array is not open ! open it
@@ -1809,6 +2012,19 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
                 {
                     u_ctx->region.p1_y = atoi(ctx->buf);
                 }
+                // optional sensitivity, debounce and cooldown of the region
+                else if (u_ctx->vidx == 5)
+                {
+                    u_ctx->region.sensitivity = atoi(ctx->buf);
+                }
+                else if (u_ctx->vidx == 6)
+                {
+                    u_ctx->region.debounce_time = atoi(ctx->buf);
+                }
+                else if (u_ctx->vidx == 7)
+                {
+                    u_ctx->region.cooldown_time = atoi(ctx->buf);
+                }
             }
             break;
 
@@ -1819,10 +2035,9 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
                 u_ctx->flag &= ~PNT_FLAG_ROI_ENTRY;
 
                 // we read 4 roi values add to message
-                if (u_ctx->vidx >= 4)
+                if (u_ctx->vidx >= ROI_VALUES)
                 {
-                    append_session_msg(
-                        u_ctx->message, "%d,%d,%d,%d", u_ctx->region.p0_x, u_ctx->region.p0_y, u_ctx->region.p1_x, u_ctx->region.p1_y);
+                    add_json_roi(u_ctx->message, u_ctx->region);
                 }
                 u_ctx->message.append("]");
 
@@ -1830,10 +2045,8 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
                 u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
                 // read up to 52 roi entries into u_ctx->region
-                if (u_ctx->midx <= 52)
+                if (cfg->setRoi(u_ctx->midx, u_ctx->region))
                 {
-                    cfg->motion.rois[u_ctx->midx] =
-                        {u_ctx->region.p0_x, u_ctx->region.p0_y, u_ctx->region.p1_x, u_ctx->region.p1_y};
                     u_ctx->midx++;
                 }
             }
@@ -1841,7 +2054,7 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
             else if (u_ctx->flag & PNT_FLAG_ROI_ARRAY)
             {
                 u_ctx->flag |= PNT_FLAG_SEPARATOR;
-                cfg->motion.roi_count = u_ctx->midx;
+                cfg->setRoiCount(u_ctx->midx);
                 u_ctx->message.append("]");
                 lejp_parser_pop(ctx);
             }
@@ -1879,6 +2092,54 @@ signed char WS::info_callback(struct lejp_ctx *ctx, char reason)
                 }
             }
             break;
+        case PNT_INFO_MOTION_HEATMAP:
+            {
+                /* {"windows":[60,3600],"frames":[f,f],"rois":[[roi,active,active],...]}
+                 * frames counts the IVS results of the last minute and hour, active
+                 * how many of them had motion in the region.
+                 */
+                MotionHeatmap map;
+                MotionStats::heatmap(map);
+                JsonWriter &msg = u_ctx->message;
+                msg.append("{\"windows\":[").num(MOTION_STATS_SECONDS).append(',')
+                    .num(MOTION_STATS_MINUTES * 60).append("],\"frames\":[")
+                    .num(map.frames[0]).append(',').num(map.frames[1]).append("],\"rois\":[");
+                for (int n = 0; n < map.roiCount; n++)
+                {
+                    if (n)
+                        msg.append(',');
+                    msg.append('[').num(map.roiIndex[n]).append(',').num(map.active[n][0])
+                        .append(',').num(map.active[n][1]).append(']');
+                }
+                msg.append("]}");
+            }
+            break;
+        case PNT_INFO_AUDIO_PIPELINE:
+#if defined(AUDIO_SUPPORT)
+            {
+                /* {"capture":{..},"encoder":{..}}, per stage the frames waiting
+                 * behind it, the average and max time per frame of the last
+                 * second in us and the frames dropped since the start
+                 */
+                JsonWriter &msg = u_ctx->message;
+                const AudioStageStats *stages[] = {&global_audio[0]->capture_stats,
+                                                   &global_audio[0]->encoder_stats};
+                const char *names[] = {"capture", "encoder"};
+                msg.append('{');
+                for (int n = 0; n < 2; n++)
+                {
+                    msg.key(n > 0, names[n], "{");
+                    msg.append("\"queue\":").num(stages[n]->queue.load())
+                        .append(",\"frame_us\":").num(stages[n]->frame_us.load())
+                        .append(",\"max_us\":").num(stages[n]->max_us.load())
+                        .append(",\"dropped\":").num(stages[n]->dropped.load()).append('}');
+                }
+                msg.append('}');
+            }
+#else
+            add_json_null(u_ctx->message);
+#endif
+            break;
         default:
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
             break;               
@@ -1965,6 +2226,177 @@ signed char WS::action_callback(struct lejp_ctx *ctx, char reason)
     return 0;
 }
 
+static void push_subscriptions(lws_sorted_usec_list_t *sul);
+
+/* run the subscription push for a session as soon as possible,
+ * but not faster than websocket.min_push_interval
+ */
+static void schedule_push(user_ctx *u_ctx)
+{
+    lws_usec_t delay = u_ctx->subscription.last_push +
+                       cfg->websocket.min_push_interval * LWS_US_PER_MS - lws_now_usecs();
+    if (delay < 1)
+        delay = 1;
+    lws_sul_schedule(lws_get_context(u_ctx->wsi), 0, &u_ctx->sul_push, push_subscriptions, delay);
+}
+
+signed char WS::subscribe_callback(struct lejp_ctx *ctx, char reason)
+{
+    struct user_ctx *u_ctx = (struct user_ctx *)ctx->user;
+
+    if ((reason & LEJP_FLAG_CB_IS_VALUE) && ctx->path_match)
+    {
+        add_json_key(u_ctx->message, (u_ctx->flag & PNT_FLAG_SEPARATOR), subscribe_keys[ctx->path_match - 1]);
+
+        u_ctx->flag |= PNT_FLAG_SEPARATOR;
+
+        if (ctx->path_match == PNT_SUBSCRIBE_INTERVAL)
+        {
+            if (reason == LEJPCB_VAL_NUM_INT)
+            {
+                u_ctx->subscription.interval = std::max(atoi(ctx->buf), cfg->websocket.min_push_interval);
+            }
+            add_json_num(u_ctx->message, u_ctx->subscription.interval);
+        }
+        else
+        {
+            int topic = 1 << (ctx->path_match - 1);
+            if (reason == LEJPCB_VAL_TRUE)
+            {
+                // (re)subscribing always sends the current value first
+                u_ctx->subscription.topics |= topic;
+                u_ctx->subscription.sent &= ~topic;
+            }
+            else if (reason == LEJPCB_VAL_FALSE)
+            {
+                u_ctx->subscription.topics &= ~topic;
+            }
+            add_json_bool(u_ctx->message, u_ctx->subscription.topics & topic);
+        }
+    }
+    else if (reason == LEJPCB_OBJECT_END)
+    {
+        u_ctx->flag |= PNT_FLAG_SEPARATOR;
+        u_ctx->message.append("}");
+        lejp_parser_pop(ctx);
+
+        if (u_ctx->subscription.topics)
+        {
+            // first push right after the response
+            subscribers.insert(u_ctx);
+            schedule_push(u_ctx);
+        }
+        else
+        {
+            subscribers.erase(u_ctx);
+            lws_sul_cancel(&u_ctx->sul_push);
+        }
+    }
+
+    return 0;
+}
+
+/* create, update, query or delete a dynamic OSD region.
+ * "name" has to be the first key, an existing region is updated with the
+ * keys that follow. the region is applied at the end of the object.
+ */
+signed char WS::osd_region_callback(struct lejp_ctx *ctx, char reason)
+{
+    struct user_ctx *u_ctx = (struct user_ctx *)ctx->user;
+    OSDRegion &region = u_ctx->osd_region;
+
+    if ((reason & LEJP_FLAG_CB_IS_VALUE) && ctx->path_match)
+    {
+        // everything but the name needs a name first, the state is added at the end
+        if ((ctx->path_match != PNT_OSD_REGION_NAME && !region.name[0]) || ctx->path_match == PNT_OSD_REGION_STATE)
+            return 0;
+
+        add_json_key(u_ctx->message, (u_ctx->flag & PNT_FLAG_SEPARATOR), osd_region_keys[ctx->path_match - 1]);
+
+        u_ctx->flag |= PNT_FLAG_SEPARATOR;
+
+        if (ctx->path_match >= PNT_OSD_REGION_STREAM && ctx->path_match <= PNT_OSD_REGION_HEIGHT)
+        { // integer values
+            int *values[] = {&region.stream, &region.x, &region.y, &region.rotation,
+                             &region.transparency, &region.width, &region.height};
+            int &value = *values[ctx->path_match - PNT_OSD_REGION_STREAM];
+            if (reason == LEJPCB_VAL_NUM_INT)
+            {
+                value = atoi(ctx->buf);
+                u_ctx->flag |= PNT_FLAG_OSD_REGION_MODIFIED;
+            }
+            add_json_num(u_ctx->message, value);
+        }
+        else
+        {
+            switch (ctx->path_match)
+            {
+            case PNT_OSD_REGION_NAME:
+                if (reason == LEJPCB_VAL_STR_END && strlen(ctx->buf) < sizeof(region.name))
+                {
+                    if (!OSDRegions::get(ctx->buf, region))
+                    {
+                        region = OSDRegion{};
+                        strcpy(region.name, ctx->buf);
+                    }
+                }
+                add_json_str(u_ctx->message, region.name);
+                break;
+            case PNT_OSD_REGION_TEXT:
+            case PNT_OSD_REGION_IMAGE:
+                if (reason == LEJPCB_VAL_STR_END && strlen(ctx->buf) < sizeof(region.text))
+                {
+                    // text or image
+                    bool text = ctx->path_match == PNT_OSD_REGION_TEXT;
+                    strcpy(text ? region.text : region.image, ctx->buf);
+                    (text ? region.image : region.text)[0] = 0;
+                    u_ctx->flag |= PNT_FLAG_OSD_REGION_MODIFIED;
+                }
+                add_json_str(u_ctx->message, ctx->path_match == PNT_OSD_REGION_TEXT ? region.text : region.image);
+                break;
+            case PNT_OSD_REGION_DELETE:
+                if (reason == LEJPCB_VAL_TRUE)
+                    u_ctx->flag |= PNT_FLAG_OSD_REGION_DELETE;
+                add_json_bool(u_ctx->message, reason == LEJPCB_VAL_TRUE);
+                break;
+            }
+        }
+    }
+    else if (reason == LEJPCB_OBJECT_END)
+    {
+        if (region.name[0])
+        {
+            const char *state;
+            OSDRegion current;
+            if (u_ctx->flag & PNT_FLAG_OSD_REGION_DELETE)
+            {
+                state = OSDRegions::remove(region.name) ? "deleted" : pnt_ws_msg[PNT_WS_MSG_ERROR];
+            }
+            else if ((u_ctx->flag & PNT_FLAG_OSD_REGION_MODIFIED) && !OSDRegions::set(region))
+            {
+                state = pnt_ws_msg[PNT_WS_MSG_ERROR];
+            }
+            else if (OSDRegions::get(region.name, current))
+            {
+                state = OSDRegions::stateName(current.state);
+            }
+            else
+            {
+                state = pnt_ws_msg[PNT_WS_MSG_NULL];
+            }
+            add_json_key(u_ctx->message, (u_ctx->flag & PNT_FLAG_SEPARATOR), osd_region_keys[PNT_OSD_REGION_STATE - 1]);
+            add_json_str(u_ctx->message, state);
+        }
+
+        u_ctx->flag |= PNT_FLAG_SEPARATOR;
+        u_ctx->flag &= ~(PNT_FLAG_OSD_REGION_DELETE | PNT_FLAG_OSD_REGION_MODIFIED);
+        u_ctx->message.append("}");
+        lejp_parser_pop(ctx);
+    }
+
+    return 0;
+}
+
 signed char WS::root_callback(struct lejp_ctx *ctx, char reason)
 {
     if ((reason & LEJPCB_OBJECT_START) && ctx->path_match)
@@ -2031,6 +2463,18 @@ signed char WS::root_callback(struct lejp_ctx *ctx, char reason)
             lejp_parser_push(ctx, u_ctx,
                              action_keys, LWS_ARRAY_SIZE(action_keys), action_callback);
             break;
+        case PNT_SUBSCRIBE:
+            if (!u_ctx->subscription.interval)
+                u_ctx->subscription.interval = cfg->websocket.min_push_interval;
+            lejp_parser_push(ctx, u_ctx,
+                             subscribe_keys, LWS_ARRAY_SIZE(subscribe_keys), subscribe_callback);
+            break;
+        case PNT_OSD_REGION:
+            u_ctx->osd_region = OSDRegion{};
+            u_ctx->flag &= ~(PNT_FLAG_OSD_REGION_DELETE | PNT_FLAG_OSD_REGION_MODIFIED);
+            lejp_parser_push(ctx, u_ctx,
+                             osd_region_keys, LWS_ARRAY_SIZE(osd_region_keys), osd_region_callback);
+            break;
         }
     }
 
@@ -2063,11 +2507,127 @@ send_snapshot(lws_sorted_usec_list_t *sul)
     lws_callback_on_writable(u_ctx->wsi);
 }
 
+/* collect changed values of all subscribed topics into one compact
+ * message, e.g. {"stats":{"stream0":{"fps":25,"Bps":51200}},"motion":{...}}
+ * and queue it. runs on the lws service thread.
+ */
+static void
+push_subscriptions(lws_sorted_usec_list_t *sul)
+{
+    struct user_ctx *u_ctx = lws_container_of(sul, struct user_ctx, sul_push);
+    struct subscription_info &sub = u_ctx->subscription;
+
+    if (!sub.topics)
+        return;
+
+    sub.last_push = lws_now_usecs();
+
+    // a slow client gets the next update when it has read the pending ones
+    if (!u_ctx->tx_queue.full())
+    {
+        JsonWriter &msg = u_ctx->message;
+        bool separator = false;
+        msg.reset();
+        msg.append('{');
+
+        if (sub.topics & PNT_TOPIC_STATS)
+        {
+            bool changed = !(sub.sent & PNT_TOPIC_STATS);
+            for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
+            {
+                changed |= sub.fps[i] != global_video[i]->stats.fps ||
+                           sub.bps[i] != (int)global_video[i]->stats.bps;
+            }
+            if (changed)
+            {
+                msg.key(separator, "stats", "{");
+                for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
+                {
+                    sub.fps[i] = global_video[i]->stats.fps;
+                    sub.bps[i] = global_video[i]->stats.bps;
+                    msg.key(i, global_video[i]->name, "{");
+                    msg.append("\"fps\":").num(sub.fps[i]).append(",\"Bps\":").num(sub.bps[i]).append('}');
+                }
+                msg.append('}');
+                separator = true;
+            }
+        }
+
+        if (sub.topics & PNT_TOPIC_MOTION)
+        {
+            unsigned int events = global_motion_events;
+            if (!(sub.sent & PNT_TOPIC_MOTION) || events != sub.motion_events)
+            {
+                sub.motion_events = events;
+                msg.key(separator, "motion", "{");
+                msg.append("\"active\":").boolean(global_motion_active);
+                msg.append(",\"events\":").num(events).append('}');
+                separator = true;
+            }
+        }
+
+        if (sub.topics & PNT_TOPIC_RESTART)
+        {
+            int restart;
+            {
+                std::unique_lock lck(mutex_main);
+                restart = (global_restart ? 1 : 0) | (global_restart_rtsp ? 2 : 0) |
+                          (global_restart_video ? 4 : 0) | (global_restart_audio ? 8 : 0);
+            }
+            if (!(sub.sent & PNT_TOPIC_RESTART) || restart != sub.restart)
+            {
+                sub.restart = restart;
+                msg.key(separator, "restart", "{");
+                msg.append("\"active\":").boolean(restart & 1);
+                msg.append(",\"rtsp\":").boolean(restart & 2);
+                msg.append(",\"video\":").boolean(restart & 4);
+                msg.append(",\"audio\":").boolean(restart & 8).append('}');
+                separator = true;
+            }
+        }
+
+#if defined(AUDIO_SUPPORT)
+        if (sub.topics & PNT_TOPIC_AUDIO)
+        {
+            int level = global_audio[0]->active ? global_audio[0]->level.load() : -96;
+            if (!(sub.sent & PNT_TOPIC_AUDIO) || level != sub.audio_level)
+            {
+                sub.audio_level = level;
+                msg.key(separator, "audio", "{");
+                msg.append("\"level\":").num(level).append('}');
+                separator = true;
+            }
+        }
+#endif
+
+        sub.sent = sub.topics;
+
+        if (separator)
+        {
+            msg.append('}');
+            queue_session_msg(u_ctx, msg);
+        }
+    }
+
+    lws_sul_schedule(lws_get_context(u_ctx->wsi), 0, &u_ctx->sul_push, push_subscriptions,
+                     sub.interval * LWS_US_PER_MS);
+}
+
 int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
 {
     struct lejp_ctx ctx;
     user_ctx *u_ctx = (struct user_ctx *)user;
 
+    /* woken up by WS::notify(), there is no session or peer for this reason.
+     * let the subscribers check for new events
+     */
+    if (reason == LWS_CALLBACK_EVENT_WAIT_CANCELLED)
+    {
+        for (user_ctx *s : subscribers)
+            schedule_push(s);
+        return 0;
+    }
+
     char client_ip[128];
     lws_get_peer_simple(wsi, client_ip, sizeof(client_ip));
 
@@ -2135,11 +2695,9 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
         LOG_DDEBUGWS("u_ctx->rx_message: id:" << u_ctx->id << ", rx:" << u_ctx->rx_message);
 
-        // set request pending
-        //u_ctx->flag |= PNT_FLAG_WS_REQUEST_PENDING;
-
         // parse json and write response into u_ctx->message
-        u_ctx->message = "{";               // open response json 
+        u_ctx->message.reset();
+        u_ctx->message.append('{');         // open response json 
         lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
         lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
         lejp_destruct(&ctx);
@@ -2147,13 +2705,6 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         u_ctx->rx_message.clear();          // cleanup received data
         u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
 
-        // splitt overlapping responses with a ";"
-        if(u_ctx->flag & PNT_FLAG_WS_REQUEST_PENDING) {
-            u_ctx->tx_message.append(";");
-        }
-
-        u_ctx->flag |= PNT_FLAG_WS_REQUEST_PENDING;
-
         // incoming snapshot request via websocket
         if (u_ctx->flag & PNT_FLAG_WS_REQUEST_PREVIEW)
         {
@@ -2205,7 +2756,7 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 u_ctx->snapshot.r = 0;
                 
                 u_ctx->snapshot.throttle +=
-                    global_jpeg[0]->stream->stats.fps - u_ctx->snapshot.rps;
+                    global_jpeg[0]->stats.fps - u_ctx->snapshot.rps;
                 
                 if (u_ctx->snapshot.throttle > 100)
                 {
@@ -2219,18 +2770,16 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 LOG_DDEBUGWS("RPS: " << u_ctx->snapshot.rps << " " << u_ctx->snapshot.throttle << " " << dur);
             }
 
-            int delay = (LWS_USEC_PER_SEC / (global_jpeg[0]->stream->stats.fps + u_ctx->snapshot.throttle)) + first_request_delay;
+            int delay = (LWS_USEC_PER_SEC / (global_jpeg[0]->stats.fps + u_ctx->snapshot.throttle)) + first_request_delay;
             LOG_DDEBUGWS("shedule preview image. id:" << u_ctx->id << " delay:" << delay);
             lws_sul_schedule(lws_get_context(wsi), 0, &u_ctx->sul, send_snapshot, delay);
 
             // send response for the image request 
-            u_ctx->tx_message.append(u_ctx->message);
-            lws_callback_on_writable(wsi);                             
+            queue_session_msg(u_ctx, u_ctx->message);
         } else {
 
             // send response for all 'non image request' json requests
-            u_ctx->tx_message.append(u_ctx->message);
-            lws_callback_on_writable(wsi);
+            queue_session_msg(u_ctx, u_ctx->message);
         }
 
         break;
@@ -2238,26 +2787,43 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
     case LWS_CALLBACK_SERVER_WRITEABLE:
         LOG_DDEBUGWS("LWS_CALLBACK_SERVER_WRITEABLE id:" << u_ctx->id << ", ip:" << client_ip);
 
-        // send response message
-        if (!u_ctx->tx_message.empty())
+        /* lws allows only one lws_write per writable callback, if the socket
+         * can't take more data yet we simply wait for the next callback
+         */
+        if (lws_send_pipe_choked(wsi))
         {
-            u_ctx->flag &= ~PNT_FLAG_WS_REQUEST_PENDING;
+            lws_callback_on_writable(wsi);
+            break;
+        }
 
-            /* send all outstanding messages
-             * if messages faster received than an answer can be send, they will append to 
-             * tx_message and separated with a ";". now we split them and send each 
-             * segment separate
-             */
-            std::stringstream ss(u_ctx->tx_message);
-            std::string item;
+        // send next queued response message
+        if (!u_ctx->tx_queue.empty())
+        {
+            size_t tx_len;
+            unsigned char *tx = u_ctx->tx_queue.front(tx_len);
+            LOG_DDEBUGWS("u_ctx->tx_queue id:" << u_ctx->id << ", tx:" << std::string((char *)tx, tx_len));
+
+            int written = lws_write(wsi, tx, tx_len, LWS_WRITE_TEXT);
+            u_ctx->tx_queue.pop();
+            if (written < 0)
+            {
+                LOG_ERROR("lws error sending response. id:" << u_ctx->id);
+                return -1;
+            }
 
-            while (std::getline(ss, item, ';')) {
-                LOG_DDEBUGWS("u_ctx->tx_message id:" << u_ctx->id << ", tx:" << item);
-                item = std::string(LWS_PRE, '\0') + item;
-                lws_write(wsi, (unsigned char *)item.c_str() + LWS_PRE, item.length() - LWS_PRE, LWS_WRITE_TEXT);
+            // resume receiving from a paused client
+            if ((u_ctx->flag & PNT_FLAG_WS_RX_PAUSED) &&
+                u_ctx->tx_queue.count <= WS_SEND_QUEUE_LOW_WATER)
+            {
+                LOG_DDEBUGWS("send queue drained, resume receiving. id:" << u_ctx->id);
+                lws_rx_flow_control(wsi, 1);
+                u_ctx->flag &= ~PNT_FLAG_WS_RX_PAUSED;
             }
 
-            u_ctx->tx_message.clear();            
+            // more messages or a preview image are waiting
+            if (!u_ctx->tx_queue.empty() || (u_ctx->flag & PNT_FLAG_WS_SEND_PREVIEW))
+                lws_callback_on_writable(wsi);
+            break;
         }
 
         // delayed snapshot request via websocket, sending the image
@@ -2279,6 +2845,8 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
         // cleanup delete possibly existing shedules for this session    
         lws_sul_cancel(&u_ctx->sul);
+        lws_sul_cancel(&u_ctx->sul_push);
+        subscribers.erase(u_ctx);
 
         u_ctx->~user_ctx();
         break;
@@ -2372,7 +2940,8 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         if (u_ctx->flag & PNT_FLAG_HTTP_RECEIVED_MESSAGE)
         {
             // parse json and write response into u_ctx->message
-            u_ctx->message = "{";               // open response json
+            u_ctx->message.reset();
+            u_ctx->message.append('{');         // open response json
             lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
             lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
             lejp_destruct(&ctx);
@@ -2381,12 +2950,6 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
             u_ctx->flag |= PNT_FLAG_HTTP_SEND_MESSAGE;
 
-            /* copy response into u_ctx->message into u_ctx->tx_message
-             * can be helpfull to handle overlapping requests in future
-             */ 
-            u_ctx->tx_message = u_ctx->message;
-            u_ctx->tx_message.clear();
-
             // send response
             lws_callback_on_writable(wsi);
 
@@ -2434,12 +2997,12 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 LOG_DDEBUGWS("/json " << u_ctx->flag);
                 if (!u_ctx->message.empty())
                 {
-                    LOG_DDEBUGWS("TO " << client_ip << ":  " << u_ctx->message);
+                    LOG_DDEBUGWS("TO " << client_ip << ":  " << std::string(u_ctx->message.data(), u_ctx->message.size()));
 
                     // Prepare the HTTP headers
-                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "application/json", u_ctx->message.length(), &p, end) ||
+                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "application/json", u_ctx->message.size(), &p, end) ||
                         lws_finalize_write_http_header(wsi, start, &p, end) ||
-                        !lws_write(wsi, (unsigned char *)u_ctx->message.c_str(), u_ctx->message.length(), LWS_WRITE_TEXT) ||
+                        !lws_write(wsi, (unsigned char *)u_ctx->message.data(), u_ctx->message.size(), LWS_WRITE_TEXT) ||
                         lws_http_transaction_completed(wsi))
                     {
 
@@ -2511,18 +3074,47 @@ void WS::start()
     if (!context)
     {
         LOG_ERROR("lws init failed");
+        return;
+    }
+
+    {
+        std::lock_guard lock(ws_context_lock);
+        ws_context = context;
     }
 
     LOG_INFO("Server started on port " << cfg->websocket.port);
 
-    while (true)
+    /* lws sleeps until there is socket activity, a scheduled timer (preview
+     * images, subscriptions) is due or another thread calls WS::notify()
+     */
+    while (running)
     {
-        lws_service(context, 50);
+        if (lws_service(context, 0) < 0)
+            break;
     }
 
-    LOG_INFO("Server stopped.");
+    {
+        std::lock_guard lock(ws_context_lock);
+        ws_context = nullptr;
+    }
 
     lws_context_destroy(context);
+    context = nullptr;
+
+    LOG_INFO("Server stopped.");
+}
+
+void WS::stop()
+{
+    running = false;
+    notify();
+}
+
+void WS::notify()
+{
+    std::lock_guard lock(ws_context_lock);
+    if (ws_context)
+        lws_cancel_service(ws_context);
 }
 
 void *WS::run(void *arg)
@@ -14,14 +14,26 @@
 #define SESSION_ID_LENGTH 16
 #define ROOT_MAX_LENGTH 16
 
+// outbound messages per websocket session, reading is paused while the queue is full
+#define WS_SEND_QUEUE_DEPTH 16
+// reading is resumed when the queue has drained to this level
+#define WS_SEND_QUEUE_LOW_WATER 4
+
 // WebSocket
 class WS
 {
 public:
         void start();
+        void stop();
         static void *run(void* arg);
 
+        /* wake up the service loop from any thread, it then pushes pending
+         * events to subscribed clients
+         */
+        static void notify();
+
 private:
+        std::atomic<bool> running{true};
         lws_protocols protocols{};
         struct lws_context_creation_info info;
         struct lws_context *context{};
@@ -43,5 +55,7 @@ private:
         static signed char motion_roi_callback(struct lejp_ctx *ctx, char reason);
         static signed char info_callback(struct lejp_ctx *ctx, char reason);
         static signed char action_callback(struct lejp_ctx *ctx, char reason);
+        static signed char subscribe_callback(struct lejp_ctx *ctx, char reason);
+        static signed char osd_region_callback(struct lejp_ctx *ctx, char reason);
 };
 #endif
@@ -1,6 +1,12 @@
 #include "WorkerUtils.hpp"
 
+#include <cerrno>
+#include <csignal>
 #include <cstddef>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char **environ;
 
 namespace WorkerUtils {
 
@@ -17,4 +23,33 @@ unsigned long long tDiffInMs(struct timeval *startTime)
     return milliseconds;
 }
 
+pid_t spawn(const char *path, char *const argv[], int stdin_fd)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (stdin_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+
+    pid_t pid;
+    int ret = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (ret != 0)
+    {
+        errno = ret;
+        return -1;
+    }
+    return pid;
+}
+
 } // namespace WorkerUtils
@@ -4,6 +4,7 @@
 #include <semaphore>
 
 #include <sys/time.h>
+#include <sys/types.h>
 
 // Struct used for signaling thread startup completion
 struct StartHelper
@@ -16,6 +17,13 @@ namespace WorkerUtils {
 
 unsigned long long tDiffInMs(struct timeval *startTime);
 
+/* posix_spawn with an empty signal mask. main blocks SIGINT and SIGTERM in
+ * all threads for its signal thread, a child would inherit that and ignore
+ * them. stdin_fd >= 0 becomes the stdin of the child.
+ * returns the pid, or -1 with errno set.
+ */
+pid_t spawn(const char *path, char *const argv[], int stdin_fd = -1);
+
 } // namespace WorkerUtils
 
 #endif // WORKERUTILS_HPP
@@ -7,6 +7,8 @@
 #include "liveMedia.hh"
 
 #include "MsgChannel.hpp"
+#include "AudioBuffer.hpp"
+#include "AudioPipe.hpp"
 #include "IMPAudio.hpp"
 #include "IMPEncoder.hpp"
 #include "IMPFramesource.hpp"
@@ -22,7 +24,7 @@ extern std::mutex mutex_main; // protects global_restart_rtsp and global_restart
 
 struct AudioFrame
 {
-	std::vector<uint8_t> data;
+	AudioBuffer data;
 	struct timeval time;
 };
 
@@ -47,6 +49,7 @@ struct jpeg_stream
     int encChn;
     int streamChn;
     _stream *stream;
+    _stream_stats stats{}; // written by the jpeg_grabber thread
     std::atomic<bool> running; // set to false to make jpeg_grabber thread exit
     std::atomic<bool> active{false};
     pthread_t thread;
@@ -92,6 +95,9 @@ struct audio_stream
     std::mutex onDataCallbackLock; // protects onDataCallback from deallocation
     std::condition_variable should_grab_frames;
     std::binary_semaphore is_activated{0};
+    std::atomic<int> level{-96}; // peak level of the last captured frame in dBFS
+    AudioStageStats capture_stats; // capture to PCM ring
+    AudioStageStats encoder_stats; // PCM ring to msgChannel
 
     StreamReplicator *streamReplicator = nullptr;
 
@@ -105,6 +111,7 @@ struct video_stream
 {
     int encChn;
     _stream *stream;
+    _stream_stats stats{}; // written by the video worker
     const char *name;
     bool running;
     pthread_t thread;
@@ -153,9 +160,12 @@ extern bool global_restart_audio;
 
 extern bool global_osd_thread_signal;
 extern bool global_main_thread_signal;
-extern bool global_motion_thread_signal;
+extern std::atomic<bool> global_motion_thread_signal; // motion detection is running
 extern std::atomic<char> global_rtsp_thread_signal;
 
+extern std::atomic<bool> global_motion_active;          // motion is currently detected
+extern std::atomic<unsigned int> global_motion_events;  // counts motion start / stop transitions
+
 extern std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS];
 extern std::shared_ptr<audio_stream> global_audio[NUM_AUDIO_CHANNELS];
 extern std::shared_ptr<video_stream> global_video[NUM_VIDEO_CHANNELS];
@@ -2,6 +2,8 @@
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <csignal>
+#include <pthread.h>
 #include "RTSP.hpp"
 #include "Logger.hpp"
 #include "Config.hpp"
@@ -15,6 +17,8 @@
 #include "globals.hpp"
 #include "IMPSystem.hpp"
 #include "Motion.hpp"
+#include "MotionEvents.hpp"
+#include "OSDRegions.hpp"
 #include "WorkerUtils.hpp"
 #include "IMPBackchannel.hpp"
 using namespace std::chrono;
@@ -31,9 +35,12 @@ bool global_restart_audio = false;
 
 bool global_osd_thread_signal = false;
 bool global_main_thread_signal = false;
-bool global_motion_thread_signal = false;
+std::atomic<bool> global_motion_thread_signal{false};
 std::atomic<char> global_rtsp_thread_signal{1};
 
+std::atomic<bool> global_motion_active{false};
+std::atomic<unsigned int> global_motion_events{0};
+
 std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS] = {nullptr};
 std::shared_ptr<video_stream> global_video[NUM_VIDEO_CHANNELS] = {nullptr};
 #if defined(AUDIO_SUPPORT)
@@ -48,6 +55,26 @@ RTSP rtsp;
 Motion motion;
 IMPSystem *imp_system = nullptr;
 
+// set by the signal thread, protected by mutex_main
+static bool shutdown_requested = false;
+
+/* SIGINT and SIGTERM are blocked in all threads and taken here, the main
+ * loop then stops the workers like for a restart and leaves.
+ */
+static void *signal_thread(void *arg)
+{
+    sigset_t *set = static_cast<sigset_t *>(arg);
+    int sig;
+    if (sigwait(set, &sig) == 0)
+    {
+        LOG_INFO("Signal " << sig << " received, shutting down.");
+        std::unique_lock lck(mutex_main);
+        shutdown_requested = true;
+        global_cv_worker_restart.notify_all();
+    }
+    return nullptr;
+}
+
 bool timesync_wait()
 {
     // I don't really have a better way to do this than
@@ -84,12 +111,24 @@ int main(int argc, const char *argv[])
     pthread_t rtsp_thread;
     pthread_t motion_thread;
     pthread_t backchannel_thread;
+    pthread_t osd_socket_thread;
+    pthread_t sig_thread;
+
+    // before any thread is created, they all inherit the mask
+    static sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+    pthread_create(&sig_thread, nullptr, signal_thread, &shutdown_signals);
+    pthread_detach(sig_thread);
 
     if (Logger::init(cfg->general.loglevel))
     {
         LOG_ERROR("Logger initialization failed.");
         return 1;
     }
+    Logger::setModuleLevels(cfg->general.module_loglevels);
     LOG_INFO("Starting Prudynt Video Server.");
 
     if (!timesync_wait())
@@ -113,7 +152,19 @@ int main(int argc, const char *argv[])
 #endif
 
     pthread_create(&cw_thread, nullptr, ConfigWatcher::thread_entry, nullptr);
-    pthread_create(&ws_thread, nullptr, WS::run, &ws);
+    bool ws_started = false;
+    if (cfg->websocket.enabled)
+    {
+        int ret = pthread_create(&ws_thread, nullptr, WS::run, &ws);
+        LOG_DEBUG_OR_ERROR(ret, "create websocket thread");
+        ws_started = ret == 0;
+    }
+
+    if (cfg->general.osd_socket[0])
+    {
+        int ret = pthread_create(&osd_socket_thread, nullptr, OSDRegions::socket_thread, nullptr);
+        LOG_DEBUG_OR_ERROR(ret, "create osd socket thread");
+    }
 
     while (true)
     {
@@ -189,9 +240,21 @@ int main(int argc, const char *argv[])
         global_restart_video = false;
         global_restart_audio = false;
         global_restart_rtsp = false;        
+
+        // restart done, inform websocket subscribers
+        WS::notify();
         
-        while (!global_restart_rtsp && !global_restart_video && !global_restart_audio)
+        while (!global_restart_rtsp && !global_restart_video && !global_restart_audio && !shutdown_requested)
             global_cv_worker_restart.wait(lck);
+
+        // a shutdown stops everything a restart would
+        bool shutdown = shutdown_requested;
+        if (shutdown)
+        {
+            global_restart_rtsp = true;
+            global_restart_video = true;
+            global_restart_audio = true;
+        }
         lck.unlock();
 
         global_restart = true;
@@ -270,7 +333,24 @@ int main(int argc, const char *argv[])
                 LOG_DEBUG_OR_ERROR(ret, "join stream0 thread");
             }
         }
+
+        if (shutdown)
+            break;
     }
 
+    // the motion thread is stopped, deliver its last events
+    MotionEvents::stop();
+
+    if (ws_started)
+    {
+        ws.stop();
+        int ret = pthread_join(ws_thread, NULL);
+        LOG_DEBUG_OR_ERROR(ret, "join websocket thread");
+    }
+
+    delete imp_system;
+    imp_system = nullptr;
+
+    LOG_INFO("Prudynt stopped.");
     return 0;
 }
@@ -0,0 +1,226 @@
+/* host test and benchmark of the software motion detector, no IMP needed.
+ *   make test
+ * feeds synthetic luma frames (static, noisy, a moving and a stopping
+ * block) and reports the time per frame.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "MotionKernel.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond, what)                                        \
+    do                                                           \
+    {                                                            \
+        if (!(cond))                                             \
+        {                                                        \
+            printf("FAIL %s:%d %s\n", __FILE__, __LINE__, what); \
+            failures++;                                          \
+        }                                                        \
+    } while (0)
+
+// deterministic noise, the same frames on every run
+static uint32_t seed = 1;
+static int noise(int amplitude)
+{
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+struct Frame
+{
+    int width;
+    int height;
+    std::vector<uint8_t> luma;
+
+    Frame(int w, int h) : width(w), height(h), luma((size_t)w * h) {}
+
+    // a gradient, so the blocks don't all look the same
+    void scene(int amplitude)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                int v = 60 + (x * 80 / width) + (y * 40 / height);
+                if (amplitude)
+                    v += noise(amplitude);
+                luma[(size_t)y * width + x] = (uint8_t)std::clamp(v, 0, 255);
+            }
+        }
+    }
+
+    void square(int x0, int y0, int size, int value)
+    {
+        for (int y = std::max(y0, 0); y < std::min(y0 + size, height); y++)
+        {
+            for (int x = std::max(x0, 0); x < std::min(x0 + size, width); x++)
+                luma[(size_t)y * width + x] = (uint8_t)value;
+        }
+    }
+};
+
+static void test_static()
+{
+    Frame f(320, 180);
+    MotionKernel k;
+    k.reset(f.width, f.height);
+
+    int moving = 0;
+    for (int i = 0; i < 50; i++)
+    {
+        f.scene(0);
+        moving += k.process(f.luma.data(), f.width, 4);
+    }
+    CHECK(moving == 0, "static scene has no motion");
+    CHECK(!k.active(0, 0, f.width - 1, f.height - 1, 4), "static scene, no active region");
+}
+
+static void test_noise()
+{
+    Frame f(320, 180);
+    MotionKernel k;
+    k.reset(f.width, f.height);
+
+    // the noise floor of the blocks adapts during the first frames
+    for (int i = 0; i < 30; i++)
+    {
+        f.scene(10);
+        k.process(f.luma.data(), f.width, 2);
+    }
+
+    int moving = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        f.scene(10);
+        moving += k.process(f.luma.data(), f.width, 2);
+    }
+    int blocks = ((f.width + 15) / 16) * ((f.height + 15) / 16);
+    printf("noise: %d moving blocks in 100 frames of %d blocks\n", moving, blocks);
+    CHECK(moving <= blocks * 100 / 1000, "sensor noise is not motion");
+}
+
+static void test_moving_block()
+{
+    Frame f(320, 180);
+    MotionKernel k;
+    k.reset(f.width, f.height);
+
+    for (int i = 0; i < 30; i++)
+    {
+        f.scene(4);
+        k.process(f.luma.data(), f.width, 2);
+    }
+
+    int hits = 0, frames = 0;
+    bool far = false;
+    for (int x = 20; x < 200; x += 8, frames++)
+    {
+        f.scene(4);
+        f.square(x, 60, 32, 230);
+        int moving = k.process(f.luma.data(), f.width, 2);
+        if (moving > 0 && k.active(x, 60, x + 31, 91, 2))
+            hits++;
+        far |= k.active(0, 140, 319, 179, 2);
+    }
+    printf("moving block: detected in %d of %d frames\n", hits, frames);
+    CHECK(hits == frames, "a moving block is detected at its position");
+    CHECK(!far, "no motion far from the block");
+
+    // it stops, the background takes it over
+    int moving = 0;
+    for (int i = 0; i < 300; i++)
+    {
+        f.scene(4);
+        f.square(200, 60, 32, 230);
+        moving = k.process(f.luma.data(), f.width, 2);
+    }
+    CHECK(moving == 0, "a stopped object becomes background");
+    CHECK(!k.active(200, 60, 231, 91, 2), "no motion at the stopped object");
+}
+
+static void test_sensitivity()
+{
+    // a faint change, only high sensitivity reports it
+    for (int sensitivity : {0, 4})
+    {
+        Frame f(320, 180);
+        MotionKernel k;
+        k.reset(f.width, f.height);
+        f.scene(0);
+        k.process(f.luma.data(), f.width, sensitivity);
+
+        f.scene(0);
+        for (int y = 64; y < 96; y++)
+        {
+            for (int x = 64; x < 96; x++)
+                f.luma[(size_t)y * f.width + x] += 10;
+        }
+        int moving = k.process(f.luma.data(), f.width, sensitivity);
+        if (sensitivity == 0)
+            CHECK(moving == 0, "faint change ignored at sensitivity 0");
+        else
+            CHECK(moving > 0 && k.active(64, 64, 95, 95, 4), "faint change detected at sensitivity 4");
+    }
+}
+
+static void test_edges()
+{
+    // sizes that are no multiple of the block size
+    Frame f(100, 70);
+    MotionKernel k;
+    k.reset(f.width, f.height);
+    f.scene(0);
+    k.process(f.luma.data(), f.width, 2);
+
+    f.scene(0);
+    f.square(96, 64, 4, 240);
+    int moving = k.process(f.luma.data(), f.width, 2);
+    CHECK(moving == 1, "motion in the partial corner block");
+    CHECK(k.active(96, 64, 99, 69, 2), "corner block is active");
+    CHECK(!k.active(0, 0, 40, 40, 2), "other corner is still");
+}
+
+static void benchmark(int width, int height)
+{
+    MotionKernel k;
+    k.reset(width, height);
+
+    const int frames = 200;
+    std::vector<Frame> input(4, Frame(width, height));
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i].scene(6);
+        input[i].square(40 + (int)i * 16, 40, 48, 220);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+        k.process(input[i % input.size()].luma.data(), width, 2);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("benchmark %dx%d: %.3f ms/frame\n", width, height, ms / frames);
+}
+
+int main()
+{
+    test_static();
+    test_noise();
+    test_moving_block();
+    test_sensitivity();
+    test_edges();
+
+    benchmark(320, 180);
+    benchmark(640, 360);
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}